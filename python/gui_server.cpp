@@ -1,10 +1,14 @@
 #include <nanobind/nanobind.h>
+#include <nanobind/stl/pair.h>
+#include <nanobind/stl/shared_ptr.h>
 #include <nanobind/stl/string.h>
+#include <nanobind/stl/vector.h>
 #include <nanobind/ndarray.h>
 
 #include <string>
 
 #include "../test_server/InterfaceServer.hpp"
+#include "../test_server/SharedSession.hpp"
 #include <opencv2/core/core.hpp>
 
 namespace nb = nanobind;
@@ -18,20 +22,65 @@ NB_MODULE(gui_server, m) {
         .def(nb::init<>())
         .def("__repr__", &InterfaceServer::State::toString)
         .def_rw("value", &InterfaceServer::State::value)
+        .def_rw("samples", &InterfaceServer::State::samples)
+        .def_rw("nif_path", &InterfaceServer::State::nifPath)
+        .def_rw("prefetch_paths", &InterfaceServer::State::prefetchPaths)
         .def_rw("stop", &InterfaceServer::State::stop);
 
+    nb::class_<FramePool::Buffer>(m, "FrameBuffer")
+        .def_ro("width", &FramePool::Buffer::width)
+        .def_ro("height", &FramePool::Buffer::height)
+        .def("array", [](FramePool::Buffer& self) {
+            // Zero-copy view of the buffer (rows are padded so strides are explicit):
+            const std::size_t shape[3] = {std::size_t(self.height), std::size_t(self.width), std::size_t(self.channels)};
+            const std::int64_t strides[3] = {std::int64_t(self.step), self.channels, 1};
+            return nb::ndarray<nb::numpy, uint8_t, nb::ndim<3>>(self.data, 3, shape, nb::handle(), strides);
+        }, nb::rv_policy::reference_internal);
+
     nb::class_<InterfaceServer>(m, "InterfaceServer")
         .def(nb::init<int>(), "port"_a)
         .def("consume_state", &InterfaceServer::consumeState)
-        .def("get_state", &InterfaceServer::getState, nb::rv_policy::reference)
+        .def("get_state", &InterfaceServer::getState)
         .def("state_changed", &InterfaceServer::stateChanged)
         .def("update_progress", &InterfaceServer::updateProgress)
+        .def("update_asset_status", &InterfaceServer::updateAssetStatus,
+             "path"_a, "progress"_a, "error"_a = "")
+        .def("update_sample_stats", &InterfaceServer::updateSampleStats,
+             "accumulated_samples"_a, "target_samples"_a)
+        .def("record_session", &InterfaceServer::recordSession, "file_name"_a)
+        .def("use_video_channel", &InterfaceServer::useVideoChannel, "video_port"_a)
+        .def("allow_shared_memory", &InterfaceServer::allowSharedMemory, "allow"_a)
+        .def("using_shared_memory", &InterfaceServer::usingSharedMemory)
+        .def("set_frame_id", &InterfaceServer::setFrameId, "frame_id"_a)
+        .def("tile_rows", [](InterfaceServer& self, std::uint32_t height) {
+            // (first, end) rows of the band this server renders in a tiled session:
+            const auto tile = self.tileAssignment();
+            return std::make_pair(tile.top(height), tile.bottom(height));
+        }, "height"_a)
+        .def("enable_damage_tracking", [](InterfaceServer& self, double threshold, float smallChangeFraction,
+                                          int smallChangeIntervalMs, int keepAliveIntervalMs) {
+            DamageTracker::Settings settings;
+            settings.threshold = threshold;
+            settings.smallChangeFraction = smallChangeFraction;
+            settings.smallChangeInterval = std::chrono::milliseconds(smallChangeIntervalMs);
+            settings.keepAliveInterval = std::chrono::milliseconds(keepAliveIntervalMs);
+            self.enableDamageTracking(settings);
+        }, "threshold"_a = 2.0, "small_change_fraction"_a = 0.05f,
+           "small_change_interval_ms"_a = 100, "keep_alive_interval_ms"_a = 1000)
+        .def("serve_metrics", &InterfaceServer::serveMetrics, "metrics_port"_a)
+        .def_static("set_tracing", &InterfaceServer::setTracing, "enable"_a)
+        .def_static("write_trace", &InterfaceServer::writeTrace, "file_name"_a)
         .def("start", &InterfaceServer::start)
         .def("wait_until_ready", &InterfaceServer::waitUntilReady)
         .def("initialise_video_stream", &InterfaceServer::initialiseVideoStream,
-             "width"_a, "height"_a)
+             "width"_a, "height"_a, "name"_a = "render_preview", "fps"_a = 30, "codec"_a = "libav", "transfer"_a = "srgb")
+        .def("is_stream_visible", &InterfaceServer::isStreamVisible, "name"_a = "render_preview")
         .def("stop", &InterfaceServer::stop)
-        .def("send_image", [](InterfaceServer& self, nb::ndarray<nb::numpy, uint8_t, nb::shape<-1, -1, 3>> array, bool convertToBGR) {
+        .def("acquire_frame", &InterfaceServer::acquireFrame, "name"_a = "render_preview",
+             nb::call_guard<nb::gil_scoped_release>())
+        .def("submit_frame", &InterfaceServer::submitFrame, "frame"_a, "name"_a = "render_preview",
+             nb::call_guard<nb::gil_scoped_release>())
+        .def("send_image", [](InterfaceServer& self, nb::ndarray<nb::numpy, uint8_t, nb::shape<-1, -1, 3>> array, bool convertToBGR, const std::string& name) {
             // Convert numpy array to cv::Mat
             int height = array.shape(0);
             int width = array.shape(1);
@@ -39,8 +88,55 @@ NB_MODULE(gui_server, m) {
             if (convertToBGR) {
                 cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
             }
-            self.sendImage(image);
-        }, "image"_a, "convert_to_bgr"_a);
+            self.sendImage(image, name);
+        }, "image"_a, "convert_to_bgr"_a, "name"_a = "render_preview")
+        .def("send_hdr_image", [](InterfaceServer& self, nb::ndarray<nb::numpy, float, nb::shape<-1, -1, 3>, nb::c_contig> array, bool convertToBGR, const std::string& name) {
+            // Wrap the linear float image (it is only copied if the channels need reordering):
+            cv::Mat image(array.shape(0), array.shape(1), CV_32FC3, array.data());
+            if (convertToBGR) {
+                cv::Mat bgr;
+                cv::cvtColor(image, bgr, cv::COLOR_RGB2BGR);
+                image = bgr;
+            }
+            nb::gil_scoped_release release;
+            self.sendHdrImage(image, name);
+        }, "image"_a, "convert_to_bgr"_a, "name"_a = "render_preview")
+        .def("send_native_image", [](InterfaceServer& self, nb::ndarray<nb::numpy, nb::ndim<3>, nb::c_contig> array, const std::string& layout,
+                                     const std::string& name, float exposure, float gamma, const std::string& curve) {
+            // Wrap uint8 or float16 pixels without copying (layout is e.g. "rgba" or "rgb_f16"):
+            const auto pixelLayout = colour::parseLayout(layout);
+            const bool half = array.dtype() != nb::dtype<uint8_t>();
+            if (half && (array.dtype().code != uint8_t(nb::dlpack::dtype_code::Float) || array.dtype().bits != 16)) {
+                throw std::invalid_argument("Images must be uint8 or float16.");
+            }
+            const int depth = half ? CV_16F : CV_8U;
+            cv::Mat image(array.shape(0), array.shape(1), CV_MAKETYPE(depth, int(array.shape(2))), array.data());
+            nb::gil_scoped_release release;
+            self.sendNativeImage(image, pixelLayout, name, tonemap::DisplaySettings{exposure, gamma, tonemap::parseCurve(curve)});
+        }, "image"_a, "layout"_a, "name"_a = "render_preview", "exposure"_a = 0.f, "gamma"_a = 2.2f, "curve"_a = "aces");
+
+    // Producer side of a shared memory session served by a separate `test-server --daemon <session>` process:
+    nb::class_<FrameProducer>(m, "FrameProducer")
+        .def(nb::init<const std::string&>(), "session"_a)
+        .def("initialise_video_stream", &FrameProducer::initialiseVideoStream,
+             "width"_a, "height"_a, "name"_a = "render_preview", "fps"_a = 30, "codec"_a = "libav", "transfer"_a = "srgb")
+        .def("send_image", [](FrameProducer& self, nb::ndarray<nb::numpy, uint8_t, nb::shape<-1, -1, 3>, nb::c_contig> array, bool convertToBGR, const std::string& name) {
+            cv::Mat image(array.shape(0), array.shape(1), CV_8UC3, array.data());
+            if (convertToBGR) {
+                cv::Mat bgr;
+                cv::cvtColor(image, bgr, cv::COLOR_RGB2BGR);
+                image = bgr;
+            }
+            nb::gil_scoped_release release;
+            self.sendImage(image, name);
+        }, "image"_a, "convert_to_bgr"_a, "name"_a = "render_preview")
+        .def("state_changed", &FrameProducer::stateChanged)
+        .def("get_state", &FrameProducer::getState)
+        .def("consume_state", &FrameProducer::consumeState)
+        .def("update_progress", &FrameProducer::updateProgress)
+        .def("update_sample_stats", &FrameProducer::updateSampleStats,
+             "accumulated_samples"_a, "target_samples"_a)
+        .def("daemon_connected", &FrameProducer::daemonConnected);
 
     m.doc() = "Extension that exposes a graphical user interface server to Python.";
 }
@@ -27,6 +27,10 @@ y_coords, x_coords = np.mgrid[0:test_image.shape[0], 0:test_image.shape[1]]
 step = 0
 total_steps = 100
 
+# Initialize fake sample accumulation:
+accumulated_samples = 0
+target_samples = 4096
+
 while not server.get_state().stop:
     # Create a scrolling colour gradient:
     shifted_x = (x_coords + frame_offset) % test_image.shape[1]
@@ -44,10 +48,15 @@ while not server.get_state().stop:
     step = (step + 1) % total_steps
     server.update_progress(step, total_steps)
 
-    # Check state and show changes:
+    # Pretend each frame accumulates the requested number of samples:
+    accumulated_samples += server.get_state().samples
+    server.update_sample_stats(accumulated_samples, target_samples)
+
+    # Check state and show changes (a real renderer would restart accumulation):
     if server.state_changed():
         state = server.consume_state()
-        print(f"Value: {state.value}")
+        print(f"Value: {state.value} Samples: {state.samples}")
+        accumulated_samples = 0
 
     # Sleep 5ms to avoid consuming too much CPU:
     time.sleep(0.005)
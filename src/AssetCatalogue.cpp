@@ -0,0 +1,197 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "AssetCatalogue.hpp"
+
+#include <boost/log/trivial.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace {
+
+const char* skipSpace(const char* c, const char* end) {
+  while (c < end && std::isspace(static_cast<unsigned char>(*c))) {
+    ++c;
+  }
+  return c;
+}
+
+/// @return Pointer one past the closing quote of the string starting at c.
+const char* skipString(const char* c, const char* end) {
+  for (++c; c < end; ++c) {
+    if (*c == '\\') {
+      ++c;
+    } else if (*c == '"') {
+      return c + 1;
+    }
+  }
+  throw std::runtime_error("Unterminated string in asset manifest.");
+}
+
+/// @return Pointer one past the end of the JSON value starting at c.
+const char* skipValue(const char* c, const char* end) {
+  if (c == end) {
+    throw std::runtime_error("Missing value in asset manifest.");
+  }
+  if (*c == '"') {
+    return skipString(c, end);
+  }
+  if (*c == '{' || *c == '[') {
+    int depth = 0;
+    while (c < end) {
+      if (*c == '"') {
+        c = skipString(c, end);
+        continue;
+      }
+      if (*c == '{' || *c == '[') {
+        depth += 1;
+      } else if (*c == '}' || *c == ']') {
+        depth -= 1;
+        if (depth == 0) {
+          return c + 1;
+        }
+      }
+      ++c;
+    }
+    throw std::runtime_error("Unterminated object in asset manifest.");
+  }
+  while (c < end && *c != ',' && *c != '}' && !std::isspace(static_cast<unsigned char>(*c))) {
+    ++c;
+  }
+  return c;
+}
+
+std::string toLower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+} // end anonymous namespace
+
+AssetCatalogue::AssetCatalogue(const std::string& manifestFile)
+    : parsed(false),
+      runParser(true) {
+  namespace ipc = boost::interprocess;
+  try {
+    file = ipc::file_mapping(manifestFile.c_str(), ipc::read_only);
+    region = ipc::mapped_region(file, ipc::read_only);
+  } catch (const ipc::interprocess_exception& e) {
+    throw std::runtime_error("Could not map asset manifest '" + manifestFile + "': " + e.what());
+  }
+  region.advise(ipc::mapped_region::advice_sequential);
+
+  BOOST_LOG_TRIVIAL(debug) << "Mapped asset manifest " << manifestFile << " (" << region.get_size() << " bytes)";
+  parserThread.reset(new std::thread(&AssetCatalogue::parse, this));
+}
+
+AssetCatalogue::~AssetCatalogue() {
+  runParser = false;
+  if (parserThread) {
+    parserThread->join();
+  }
+}
+
+std::size_t AssetCatalogue::size() const {
+  std::lock_guard<std::mutex> lock(entriesMutex);
+  return entries.size();
+}
+
+AssetCatalogue::Entry AssetCatalogue::at(std::size_t index) const {
+  std::lock_guard<std::mutex> lock(entriesMutex);
+  return entries.at(index);
+}
+
+std::vector<std::string> AssetCatalogue::thumbnails() const {
+  std::lock_guard<std::mutex> lock(entriesMutex);
+  std::vector<std::string> paths;
+  paths.reserve(entries.size());
+  for (const auto& entry : entries) {
+    paths.push_back(entry.thumbnail);
+  }
+  return paths;
+}
+
+bool AssetCatalogue::appendMatches(const std::string& text, std::size_t begin, std::size_t end,
+                                   std::size_t maxMatches, std::vector<std::size_t>& matches) const {
+  const auto needle = toLower(text);
+  const auto initialSize = matches.size();
+  std::lock_guard<std::mutex> lock(entriesMutex);
+  end = std::min(end, entries.size());
+  for (auto i = begin; i < end && matches.size() < maxMatches; ++i) {
+    if (needle.empty() || toLower(entries[i].name).find(needle) != std::string::npos) {
+      matches.push_back(i);
+    }
+  }
+  return matches.size() != initialSize;
+}
+
+/// Scan the top level members of the manifest object. Each member is
+/// parsed individually (so the full document is never held as a tree)
+/// and published in batches to limit contention with the UI thread.
+void AssetCatalogue::parse() {
+  namespace pt = boost::property_tree;
+  const std::size_t batchSize = 256;
+  const char* c = static_cast<const char*>(region.get_address());
+  const char* end = c + region.get_size();
+  std::vector<Entry> batch;
+  batch.reserve(batchSize);
+
+  auto publish = [&]() {
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    entries.insert(entries.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+    batch.clear();
+  };
+
+  try {
+    c = skipSpace(c, end);
+    if (c == end || *c != '{') {
+      throw std::runtime_error("Asset manifest must be a JSON object.");
+    }
+    c = skipSpace(c + 1, end);
+
+    while (runParser && c < end && *c != '}') {
+      const char* keyBegin = c;
+      c = skipSpace(skipString(c, end), end);
+      if (c == end || *c != ':') {
+        throw std::runtime_error("Expected ':' in asset manifest.");
+      }
+      c = skipSpace(c + 1, end);
+      const char* valueEnd = skipValue(c, end);
+
+      // Parse just this member as a small self contained document:
+      std::stringstream member;
+      member << "{";
+      member.write(keyBegin, valueEnd - keyBegin);
+      member << "}";
+      pt::ptree tree;
+      pt::read_json(member, tree);
+      const auto& item = tree.front();
+      Entry entry;
+      entry.name = item.first;
+      if (item.second.empty()) {
+        entry.path = item.second.get_value<std::string>();
+      } else {
+        entry.path = item.second.get<std::string>("path");
+        entry.thumbnail = item.second.get<std::string>("thumbnail", "");
+      }
+      batch.push_back(std::move(entry));
+      if (batch.size() == batchSize) {
+        publish();
+      }
+
+      c = skipSpace(valueEnd, end);
+      if (c < end && *c == ',') {
+        c = skipSpace(c + 1, end);
+      }
+    }
+  } catch (const std::exception& e) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to parse asset manifest: " << e.what();
+  }
+
+  publish();
+  parsed = true;
+  BOOST_LOG_TRIVIAL(info) << "Loaded " << size() << " entries from asset manifest.";
+}
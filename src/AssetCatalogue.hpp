@@ -0,0 +1,61 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Catalogue of the assets available on the remote. The manifest is a
+/// JSON object that maps display names to either a path string or an
+/// object with "path" and (optional) "thumbnail" members.
+///
+/// The manifest file is memory mapped and parsed on a background thread
+/// so that very large catalogues do not block start-up. Entries become
+/// visible in batches as they are parsed.
+class AssetCatalogue {
+public:
+  struct Entry {
+    std::string name;
+    std::string path;
+    std::string thumbnail;
+  };
+
+  AssetCatalogue(const std::string& manifestFile);
+  virtual ~AssetCatalogue();
+
+  /// Number of entries parsed so far.
+  std::size_t size() const;
+
+  /// True once the whole manifest has been parsed.
+  bool complete() const { return parsed; }
+
+  Entry at(std::size_t index) const;
+
+  /// The thumbnail path of every entry parsed so far (in catalogue order).
+  std::vector<std::string> thumbnails() const;
+
+  /// Append the indices of entries in [begin, end) whose names contain
+  /// text (case insensitive) to matches until it holds maxMatches items.
+  /// @return true if any matches were appended.
+  bool appendMatches(const std::string& text, std::size_t begin, std::size_t end,
+                     std::size_t maxMatches, std::vector<std::size_t>& matches) const;
+
+private:
+  void parse();
+
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+
+  mutable std::mutex entriesMutex;
+  std::vector<Entry> entries;
+  std::atomic<bool> parsed;
+  std::atomic<bool> runParser;
+  std::unique_ptr<std::thread> parserThread;
+};
@@ -1,18 +1,27 @@
 // Copyright (c) 2022 Graphcore Ltd. All rights reserved.
 
 #include "ControlsForm.hpp"
+#include "custom_widgets/filterbox.hpp"
 #include "custom_widgets/rotator.hpp"
+#include "custom_widgets/thumbnailgrid.hpp"
 
 #include <PacketSerialisation.h>
 #include <cereal/types/string.hpp>
 
 #include <boost/log/trivial.hpp>
 
+#include <algorithm>
 #include <iomanip>
 #include <fstream>
+#include <limits>
+#include <sstream>
 
 #include <opencv2/highgui.hpp>
 
+// Large catalogues are filtered rather than listed in full:
+const std::size_t maxNifChooserItems = 100;
+const std::size_t noNifSelected = std::numeric_limits<std::size_t>::max();
+
 std::uint32_t convertSampleValue(float value) {
   // Maximum of 16 otherwise latency will be too high:
   std::uint32_t sampleCount = value * 16;
@@ -23,39 +32,124 @@ std::uint32_t convertSampleValue(float value) {
 ControlsForm::ControlsForm(nanogui::Screen* screen,
                            PacketMuxer& sender,
                            PacketDemuxer& receiver,
-                           VideoPreviewWindow* videoPreview)
+                           VideoPreviewWindow* videoPreview,
+                           const AssetCatalogue* nifCatalogue,
+                           const std::string& thumbnailCacheDir,
+                           std::vector<PacketMuxer*> tileSenders)
     : nanogui::FormHelper(screen),
+      sender(sender),
+      tileSenders(std::move(tileSenders)),
+      catalogue(nifCatalogue),
+      nifFilter(nullptr),
+      nifChooser(nullptr),
+      nifThumbnails(nullptr),
+      thumbnailCache(receiver, thumbnailCacheDir),
+      thumbnailsRequested(false),
+      nifScanned(0),
+      selectedNif(noNifSelected),
       saveButton(nullptr),
+      samplesPerPass(0),
+      streamsGroupAdded(false),
       preview(videoPreview)
 {
   window = add_window(nanogui::Vector2i(10, 10), "Control");
 
+  // Scene selection
+  add_group("Scene");
+  nifFilter = new FilterBox(window, "Type to filter...");
+  nifFilter->set_edit_callback([this](const std::string& text) {
+    setNifFilter(text);
+  });
+  add_widget("Search", nifFilter);
+  nifChooser = new nanogui::ComboBox(window);
+  nifChooser->set_callback([this](int index) {
+    selectNif(nifMatches.at(index));
+    nifThumbnails->set_selected_index(index);
+  });
+  add_widget("NIF", nifChooser);
+  nifChooser->set_tooltip("Select the scene to render (loading progress is shown in the progress bar).");
+  auto* thumbnailPanel = new nanogui::VScrollPanel(window);
+  thumbnailPanel->set_fixed_height(160);
+  nifThumbnails = new ThumbnailGrid(thumbnailPanel);
+  nifThumbnails->set_callback([this](int index) {
+    selectNif(nifMatches.at(index));
+    nifChooser->set_selected_index(index);
+  });
+  add_widget("", thumbnailPanel);
+  // The catalogue loads in the background so the chooser is populated by updateNifList().
+  thumbnailCache.setReadyCallback([screen]() { screen->redraw(); });
+
   // Scene controls
   add_group("Custom controls");
   auto* rotationWheel = new Rotator(window);
-  rotationWheel->set_callback([&](float value) {
-    serialise(sender, "value", value);
+  rotationWheel->set_callback([this](float value) {
+    sendValue(value);
   });
   add_widget("Value rotator", rotationWheel);
   rotationWheel->set_tooltip("Example custom rotator.");
+  auto* reprojectToggle = new nanogui::CheckBox(window, "Predict rotation", [this](bool enable) {
+    if (preview != nullptr) {
+      preview->setReprojection(enable);
+    }
+  });
+  reprojectToggle->set_checked(false);
+  reprojectToggle->set_tooltip("Rotate the last frame locally while the server renders the new view.");
+  add_widget("", reprojectToggle);
+  auto* pacingToggle = new nanogui::CheckBox(window, "Smooth playback", [this](bool enable) {
+    if (preview != nullptr) {
+      preview->setFramePacing(enable);
+    }
+  });
+  pacingToggle->set_checked(false);
+  pacingToggle->set_tooltip("Buffer frames to show them at an even rate (adds latency when the network is bursty).");
+  add_widget("", pacingToggle);
 
   // Camera controls
   add_group("Other controls");
   slider = new nanogui::Slider(window);
   slider->set_fixed_width(250);
-  slider->set_callback([&](float value) {
-    serialise(sender, "value", value);
+  slider->set_callback([this](float value) {
+    sendValue(value);
   });
   slider->set_value(0.f);
   slider->callback()(slider->value());
   add_widget("Value slider", slider);
 
+  // Render controls
+  add_group("Render controls");
+  auto* samplesPanel = new nanogui::Widget(window);
+  samplesPanel->set_layout(new nanogui::BoxLayout(nanogui::Orientation::Horizontal,
+                                                  nanogui::Alignment::Middle, 0, 6));
+  auto* samplesSlider = new nanogui::Slider(samplesPanel);
+  samplesSlider->set_fixed_width(180);
+  samplesText = new nanogui::TextBox(samplesPanel, "-");
+  samplesText->set_editable(false);
+  samplesText->set_fixed_width(64);
+  samplesText->set_units("spp");
+  samplesText->set_alignment(nanogui::TextBox::Alignment::Right);
+  samplesSlider->set_callback([this](float value) {
+    // Only send a message (which restarts accumulation) when the count actually changes:
+    const auto samples = convertSampleValue(value);
+    samplesText->set_value(std::to_string(samples));
+    if (samples != samplesPerPass) {
+      samplesPerPass = samples;
+      broadcast("samples", samplesPerPass);
+    }
+  });
+  samplesSlider->set_value(0.f);
+  samplesSlider->callback()(samplesSlider->value());
+  add_widget("Samples/pass", samplesPanel);
+  samplesPanel->set_tooltip("Samples per pixel per render pass: more samples converge faster but increase latency.");
+
+  addDisplayControls();
+
   // Subscribe to FOV updates from the server (on start-up the server can decide the initial value):
   subs["value"] = receiver.subscribe("value", [this](const ComPacket::ConstSharedPacket& packet) {
     float value = 0.f;
     deserialise(packet, value);
     BOOST_LOG_TRIVIAL(trace) << "Received value update: " << value;
     slider->set_value(value);
+    m_screen->redraw();
   });
 
   // Info/stats/status:
@@ -63,17 +157,40 @@ ControlsForm::ControlsForm(nanogui::Screen* screen,
   auto progress = new nanogui::ProgressBar(window);
   add_widget("Progress", progress);
 
-  add_button("Stop", [screen, &sender]() {
-    serialise(sender, "stop", true);
+  add_button("Stop", [this, screen]() {
+    broadcast("stop", true);
     screen->set_visible(false);
   })->set_tooltip("Stop the remote application.");
 
   // Make a subscriber to receive progress updates:
   // (the progress pointer needs to be captured by value).
-  subs["progress"] = receiver.subscribe("progress", [progress](const ComPacket::ConstSharedPacket& packet) {
+  subs["progress"] = receiver.subscribe("progress", [progress, screen](const ComPacket::ConstSharedPacket& packet) {
     float progressValue = 0.f;
     deserialise(packet, progressValue);
     progress->set_value(progressValue);
+    screen->redraw();
+  });
+
+  // Asset loads on the server also report into the progress bar:
+  // (the tooltip is set by updateStatus() on the UI thread):
+  progressBar = progress;
+  subs["nif_status"] = receiver.subscribe("nif_status", [this, progress, screen](const ComPacket::ConstSharedPacket& packet) {
+    packets::AssetStatus status;
+    deserialise(packet, status);
+    std::string tooltip;
+    if (!status.error.empty()) {
+      BOOST_LOG_TRIVIAL(error) << "Server failed to load " << status.path << ": " << status.error;
+      tooltip = "Failed to load " + status.path + ": " + status.error;
+    } else {
+      BOOST_LOG_TRIVIAL(debug) << "Loading " << status.path << ": " << 100.f * status.progress << "%";
+    }
+    {
+      std::lock_guard<std::mutex> lock(statusMutex);
+      progressTooltip = tooltip;
+      progressTooltipChanged = true;
+    }
+    progress->set_value(status.progress);
+    screen->redraw();
   });
 
   add_group("Info/Stats");
@@ -89,6 +206,36 @@ ControlsForm::ControlsForm(nanogui::Screen* screen,
   frameRateText->set_alignment(nanogui::TextBox::Alignment::Right);
   add_widget("Frame rate:", frameRateText);
 
+  accumulatedText = new nanogui::TextBox(window, "-");
+  accumulatedText->set_editable(false);
+  accumulatedText->set_units("spp");
+  accumulatedText->set_alignment(nanogui::TextBox::Alignment::Right);
+  add_widget("Accumulated:", accumulatedText);
+
+  throughputText = new nanogui::TextBox(window, "-");
+  throughputText->set_editable(false);
+  throughputText->set_units("spp/sec");
+  throughputText->set_alignment(nanogui::TextBox::Alignment::Right);
+  add_widget("Throughput:", throughputText);
+
+  convergeText = new nanogui::TextBox(window, "-");
+  convergeText->set_editable(false);
+  convergeText->set_units("sec");
+  convergeText->set_alignment(nanogui::TextBox::Alignment::Right);
+  add_widget("Converged in:", convergeText);
+
+  // The text is formatted by updateStatus() on the UI thread:
+  subs["sample_stats"] = receiver.subscribe("sample_stats", [this](const ComPacket::ConstSharedPacket& packet) {
+    packets::SampleStats stats;
+    deserialise(packet, stats);
+    {
+      std::lock_guard<std::mutex> lock(statusMutex);
+      sampleStats = stats;
+      sampleStatsChanged = true;
+    }
+    m_screen->redraw();
+  });
+
   add_group("File Manager");
   saveButton = add_button("Save image", [this]() {
     saveImage();
@@ -96,10 +243,206 @@ ControlsForm::ControlsForm(nanogui::Screen* screen,
   saveButton->set_tooltip("Save preview image locally.");
 }
 
+void ControlsForm::updateStatus() {
+  packets::SampleStats stats;
+  bool statsChanged = false;
+  std::string tooltip;
+  bool tooltipChanged = false;
+  {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    stats = sampleStats;
+    std::swap(statsChanged, sampleStatsChanged);
+    tooltip = progressTooltip;
+    std::swap(tooltipChanged, progressTooltipChanged);
+  }
+  if (tooltipChanged) {
+    progressBar->set_tooltip(tooltip);
+  }
+  if (!statsChanged) {
+    return;
+  }
+  std::stringstream ss;
+  ss << stats.accumulated << "/" << stats.target;
+  accumulatedText->set_value(ss.str());
+  ss.str(std::string());
+  ss << std::fixed << std::setprecision(1) << stats.samplesPerSecond;
+  throughputText->set_value(ss.str());
+  ss.str(std::string());
+  if (stats.secondsToConverge < 0.f) {
+    ss << "-";
+  } else {
+    ss << std::fixed << std::setprecision(1) << stats.secondsToConverge;
+  }
+  convergeText->set_value(ss.str());
+}
+
+/// Exposure and tone mapping are applied by the client (for HDR streams)
+/// so these controls send nothing to the server.
+void ControlsForm::addDisplayControls() {
+  add_group("Display (HDR streams)");
+  auto addSlider = [this](const std::string& label, const std::string& units, float minValue, float maxValue,
+                          float initial, std::function<void(float)> apply) {
+    auto* panel = new nanogui::Widget(window);
+    panel->set_layout(new nanogui::BoxLayout(nanogui::Orientation::Horizontal, nanogui::Alignment::Middle, 0, 6));
+    auto* slider = new nanogui::Slider(panel);
+    slider->set_fixed_width(180);
+    slider->set_range({minValue, maxValue});
+    auto* text = new nanogui::TextBox(panel, "-");
+    text->set_editable(false);
+    text->set_fixed_width(64);
+    text->set_units(units);
+    text->set_alignment(nanogui::TextBox::Alignment::Right);
+    slider->set_callback([this, text, apply](float value) {
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(1) << value;
+      text->set_value(ss.str());
+      apply(value);
+      if (preview != nullptr) {
+        preview->setDisplaySettings(displaySettings);
+      }
+    });
+    slider->set_value(initial);
+    slider->callback()(initial);
+    add_widget(label, panel);
+    return panel;
+  };
+
+  addSlider("Exposure", "EV", -4.f, 4.f, displaySettings.exposure,
+            [this](float value) { displaySettings.exposure = value; })
+      ->set_tooltip("Exposure adjustment in stops.");
+  addSlider("Gamma", "", 1.f, 3.f, displaySettings.gamma,
+            [this](float value) { displaySettings.gamma = value; })
+      ->set_tooltip("Display gamma applied after the tone curve.");
+
+  auto* curveChooser = new nanogui::ComboBox(window, {"ACES filmic", "Reinhard", "Clamp"});
+  curveChooser->set_callback([this](int index) {
+    const tonemap::Curve curves[] = {tonemap::Curve::Aces, tonemap::Curve::Reinhard, tonemap::Curve::Clamp};
+    displaySettings.curve = curves[index];
+    if (preview != nullptr) {
+      preview->setDisplaySettings(displaySettings);
+    }
+  });
+  add_widget("Tone curve", curveChooser);
+  curveChooser->set_tooltip("Curve that maps HDR values into the display range.");
+}
+
+void ControlsForm::addVideoStream(const std::string& name, std::function<void(bool)> setVisible) {
+  if (!streamsGroupAdded) {
+    add_group("Video streams");
+    streamsGroupAdded = true;
+  }
+  auto* toggle = new nanogui::CheckBox(window, name, setVisible);
+  toggle->set_checked(true);
+  toggle->set_tooltip("Hidden streams are not decoded and the server stops sending them.");
+  add_widget("", toggle);
+  m_screen->perform_layout();
+}
+
 void ControlsForm::set_position(const nanogui::Vector2i& pos) {
   window->set_position(pos);
 }
 
+bool ControlsForm::nifListPending() const {
+  return catalogue != nullptr && (!catalogue->complete() || nifScanned != catalogue->size());
+}
+
+void ControlsForm::updateNifList() {
+  if (catalogue == nullptr) {
+    return;
+  }
+
+  // Thumbnails are requested in one go once the whole catalogue is known:
+  if (!thumbnailsRequested && catalogue->complete()) {
+    thumbnailCache.request(sender, catalogue->thumbnails());
+    thumbnailsRequested = true;
+  }
+  if (thumbnailCache.available()) {
+    auto atlas = thumbnailCache.take();
+    nifThumbnails->set_atlas(std::move(atlas.rgba), atlas.width, atlas.height,
+                             atlas.layout.tileWidth, atlas.layout.tileHeight,
+                             atlas.layout.columns, atlas.layout.count);
+  }
+
+  const auto count = catalogue->size();
+  if (count == nifScanned) {
+    return;
+  }
+
+  // Only entries that arrived since the last update need to be checked:
+  const bool added = catalogue->appendMatches(nifFilterText, nifScanned, count, maxNifChooserItems, nifMatches);
+  nifScanned = count;
+  if (added) {
+    refreshNifChooser();
+  }
+
+  // Select something as soon as the catalogue has entries:
+  if (selectedNif == noNifSelected && !nifMatches.empty()) {
+    selectNif(nifMatches.front());
+  }
+}
+
+void ControlsForm::setNifFilter(const std::string& text) {
+  nifFilterText = text;
+  nifMatches.clear();
+  nifScanned = 0;
+  updateNifList();
+  if (nifMatches.empty()) {
+    refreshNifChooser();
+  }
+}
+
+void ControlsForm::refreshNifChooser() {
+  std::vector<std::string> names;
+  names.reserve(nifMatches.size());
+  for (auto index : nifMatches) {
+    names.push_back(catalogue->at(index).name);
+  }
+  nifChooser->set_items(names);
+  nifThumbnails->set_items(nifMatches, names);
+
+  auto itr = std::find(nifMatches.begin(), nifMatches.end(), selectedNif);
+  const int selectedIndex = itr != nifMatches.end() ? itr - nifMatches.begin() : -1;
+  if (selectedIndex >= 0) {
+    nifChooser->set_selected_index(selectedIndex);
+  }
+  nifThumbnails->set_selected_index(selectedIndex);
+  m_screen->perform_layout();
+}
+
+/// Every control that changes the value must go through here so that the
+/// preview predicts the view from the newest value.
+void ControlsForm::sendValue(float value) {
+  broadcast("value", value);
+  if (preview != nullptr) {
+    preview->predictValue(value);
+  }
+}
+
+/// Ask the server to switch to the NIF at catalogueIndex and hint
+/// that it should prefetch the neighbouring entries.
+void ControlsForm::selectNif(std::size_t catalogueIndex) {
+  const auto count = catalogue->size();
+  if (catalogueIndex >= count) {
+    return;
+  }
+  selectedNif = catalogueIndex;
+  const auto path = catalogue->at(catalogueIndex).path;
+  BOOST_LOG_TRIVIAL(info) << "Selecting NIF: " << path;
+  broadcast("load_nif", path);
+
+  std::vector<std::string> neighbours;
+  for (std::size_t offset : {std::size_t(1), count - 1}) {
+    const auto neighbour = (catalogueIndex + offset) % count;
+    if (neighbour != catalogueIndex) {
+      auto neighbourPath = catalogue->at(neighbour).path;
+      if (std::find(neighbours.begin(), neighbours.end(), neighbourPath) == neighbours.end()) {
+        neighbours.push_back(neighbourPath);
+      }
+    }
+  }
+  broadcast("prefetch_nifs", neighbours);
+}
+
 void ControlsForm::saveImage() const {
   const std::string fn = "preview.png";
   BOOST_LOG_TRIVIAL(info) << "Saving image as " << fn;
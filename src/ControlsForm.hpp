@@ -3,41 +3,105 @@
 #pragma once
 
 #include <PacketComms.h>
+#include <PacketSerialisation.h>
 #include <nanogui/nanogui.h>
 
 #include <map>
 #include <mutex>
 
+#include "AssetCatalogue.hpp"
 #include "PacketDescriptions.hpp"
+#include "ThumbnailCache.hpp"
 #include "VideoPreviewWindow.hpp"
 
+class FilterBox;
+class ThumbnailGrid;
+
 /// This control window sends and receives messages via a
 /// PacketMuxer and PacketDemuxer to enact a remote-controlled
 /// user interface.
 class ControlsForm : public nanogui::FormHelper {
 public:
-  using FileLookup = std::map<std::string, std::string>;
-
-  ControlsForm(nanogui::Screen* screen, PacketMuxer& sender, PacketDemuxer& receiver, VideoPreviewWindow* videoPreview);
+  /// The catalogue can be null (the NIF chooser will be empty) and must outlive this form.
+  /// Thumbnails for the catalogue entries are cached in thumbnailCacheDir.
+  /// Control changes are also sent to each of the tileSenders (servers that
+  /// render other bands of the preview, see TileServers).
+  ControlsForm(nanogui::Screen* screen, PacketMuxer& sender, PacketDemuxer& receiver, VideoPreviewWindow* videoPreview,
+               const AssetCatalogue* nifCatalogue, const std::string& thumbnailCacheDir,
+               std::vector<PacketMuxer*> tileSenders = {});
 
   void set_position(const nanogui::Vector2i& pos);
 
+  /// Add any newly parsed catalogue entries that match the current
+  /// filter to the NIF chooser and show thumbnails once they arrive.
+  /// Call from the UI thread.
+  void updateNifList();
+
+  /// True while the catalogue is still loading or has entries that
+  /// updateNifList() has not processed yet.
+  bool nifListPending() const;
+
+  /// Show the latest sample stats and asset status from the server (they
+  /// are received on the comms thread). Call from the UI thread.
+  void updateStatus();
+
+  /// Add a checkbox that shows/hides a video stream. The callback
+  /// receives the new visibility.
+  void addVideoStream(const std::string& name, std::function<void(bool)> setVisible);
+
   nanogui::TextBox* bitRateText;
   nanogui::TextBox* frameRateText;
 
 private:
   void saveImage() const;
+  void selectNif(std::size_t catalogueIndex);
+  void setNifFilter(const std::string& text);
+  void refreshNifChooser();
+  void addDisplayControls();
+  void sendValue(float value);
+
+  /// Send a control packet to the server and to every tile server.
+  template <class T>
+  void broadcast(const std::string& type, const T& value) {
+    serialise(sender, type, value);
+    for (auto* tileSender : tileSenders) {
+      serialise(*tileSender, type, value);
+    }
+  }
 
   nanogui::Window* window;
 
   // We need to hold onto these pointers so that
   // subscriber callbacks can access them:
+  PacketMuxer& sender;
+  std::vector<PacketMuxer*> tileSenders;
+  const AssetCatalogue* catalogue;
+  FilterBox* nifFilter;
   nanogui::ComboBox* nifChooser;
+  ThumbnailGrid* nifThumbnails;
+  ThumbnailCache thumbnailCache;
+  bool thumbnailsRequested;
+  std::string nifFilterText;
+  std::vector<std::size_t> nifMatches; // Catalogue indices in the same order as the chooser items.
+  std::size_t nifScanned;              // Number of catalogue entries checked against the filter so far.
+  std::size_t selectedNif;
   nanogui::Button* saveButton;
   nanogui::Slider* slider;
   std::map<std::string, PacketSubscription> subs;
 
   nanogui::TextBox* samplesText;
+  nanogui::TextBox* accumulatedText;
+  nanogui::TextBox* throughputText;
+  nanogui::TextBox* convergeText;
+  nanogui::ProgressBar* progressBar;
+  std::mutex statusMutex; // Protects the status received from the server (below).
+  packets::SampleStats sampleStats;
+  bool sampleStatsChanged = false;
+  std::string progressTooltip;
+  bool progressTooltipChanged = false;
+  std::uint32_t samplesPerPass;
+  bool streamsGroupAdded;
+  tonemap::DisplaySettings displaySettings;
 
   // Receive raw image:
   VideoPreviewWindow* preview;
@@ -0,0 +1,103 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "DecodePool.hpp"
+#include "Trace.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+DecodePool::DecodePool(std::size_t threadCount)
+    : nextSource(0),
+      running(true) {
+  for (std::size_t i = 0; i < std::max<std::size_t>(threadCount, 1); ++i) {
+    threads.emplace_back(&DecodePool::workerLoop, this, i);
+  }
+  BOOST_LOG_TRIVIAL(debug) << "Launched " << threads.size() << " video decode threads.";
+}
+
+DecodePool::~DecodePool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  workAvailable.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_LOG_TRIVIAL(debug) << "Video decode threads joined successfully.";
+}
+
+void DecodePool::add(Source* source) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sources.push_back(Entry{source, false});
+  }
+  workAvailable.notify_all();
+}
+
+void DecodePool::remove(Source* source) {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto find = [&]() {
+    return std::find_if(sources.begin(), sources.end(), [&](const Entry& e) { return e.source == source; });
+  };
+  workAvailable.wait(lock, [&]() { return find() == sources.end() || !find()->busy; });
+  auto itr = find();
+  if (itr != sources.end()) {
+    sources.erase(itr);
+  }
+}
+
+void DecodePool::notify() {
+  // Lock so the notification cannot fall between a worker's check and its wait:
+  std::lock_guard<std::mutex> lock(mutex);
+  workAvailable.notify_one();
+}
+
+void DecodePool::workerLoop(std::size_t index) {
+  trace::setThreadName("video_decode_" + std::to_string(index));
+  std::unique_lock<std::mutex> lock(mutex);
+  while (running) {
+    // Find the next stream (round-robin) that has work and is not already being decoded:
+    Source* source = nullptr;
+    auto recheck = std::chrono::steady_clock::time_point::max();
+    for (std::size_t i = 0; i < sources.size() && source == nullptr; ++i) {
+      auto& entry = sources[(nextSource + i) % sources.size()];
+      if (entry.busy) {
+        continue;
+      }
+      if (entry.source->readyToDecode()) {
+        entry.busy = true;
+        source = entry.source;
+        nextSource = (nextSource + i + 1) % sources.size();
+      } else {
+        recheck = std::min(recheck, entry.source->recheckTime());
+      }
+    }
+
+    if (source == nullptr) {
+      if (recheck == std::chrono::steady_clock::time_point::max()) {
+        workAvailable.wait(lock);
+      } else {
+        workAvailable.wait_until(lock, recheck);
+      }
+      continue;
+    }
+
+    lock.unlock();
+    try {
+      source->decode();
+    } catch (const std::exception& e) {
+      BOOST_LOG_TRIVIAL(error) << "Exception while decoding video: " << e.what();
+    }
+    lock.lock();
+
+    for (auto& entry : sources) {
+      if (entry.source == source) {
+        entry.busy = false;
+      }
+    }
+    workAvailable.notify_all();
+  }
+}
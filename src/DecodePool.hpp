@@ -0,0 +1,59 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of threads that decode video for any number of streams.
+/// Streams are serviced round-robin and a stream is only decoded when it
+/// reports that it is ready (e.g. it is visible and has packets queued)
+/// so hidden or idle streams cost nothing. Each stream is decoded by at
+/// most one thread at a time. Threads sleep until notify() is called, so
+/// whatever makes a source ready must call it.
+class DecodePool {
+public:
+  class Source {
+  public:
+    virtual ~Source() {}
+    /// Called with the pool's lock held so must be cheap and non-blocking.
+    virtual bool readyToDecode() const = 0;
+    /// When a source that is not ready could become ready without a notify()
+    /// (e.g. a timeout expiring). Called with the pool's lock held.
+    virtual std::chrono::steady_clock::time_point recheckTime() const {
+      return std::chrono::steady_clock::time_point::max();
+    }
+    virtual void decode() = 0;
+  };
+
+  DecodePool(std::size_t threadCount);
+  virtual ~DecodePool();
+
+  void add(Source* source);
+
+  /// Blocks until the source is not being decoded.
+  void remove(Source* source);
+
+  /// Wake a thread to check for work. Must be called whenever a source may
+  /// have become ready (e.g. a packet arrives or the display frees a buffer).
+  void notify();
+
+private:
+  struct Entry {
+    Source* source;
+    bool busy;
+  };
+
+  void workerLoop(std::size_t index);
+
+  std::vector<Entry> sources;
+  std::size_t nextSource;
+  std::mutex mutex;
+  std::condition_variable workAvailable;
+  bool running;
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,238 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "HeadlessClient.hpp"
+
+#include <PacketSerialisation.h>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace {
+
+std::int64_t microsecondsNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // end anonymous namespace
+
+HeadlessClient::HeadlessClient(PacketMuxer& tx, PacketDemuxer& rx, PacketDemuxer& videoRx)
+    : sender(tx),
+      receiver(rx),
+      controlRoundTrip(metrics::registry().histogram("control_rtt_ms")),
+      pingInterval(0),
+      running(false) {
+  // The pong echoes the time at which its ping was sent:
+  pongSubscription = receiver.subscribe("pong", [this](const ComPacket::ConstSharedPacket& packet) {
+    std::int64_t sentTime = 0;
+    deserialise(packet, sentTime);
+    controlRoundTrip.record((microsecondsNow() - sentTime) / 1000.0);
+  });
+  videoClient = std::make_unique<VideoClient>(videoRx, "render_preview");
+  syncWithServer(sender, receiver, "ready");
+}
+
+HeadlessClient::~HeadlessClient() {
+  running = false;
+  if (scriptThread) {
+    scriptThread->join();
+  }
+  if (pingThread) {
+    pingThread->join();
+  }
+}
+
+std::vector<HeadlessClient::ControlEvent> HeadlessClient::loadScript(const std::string& fileName) {
+  std::ifstream file(fileName);
+  if (!file) {
+    throw std::runtime_error("Could not open control script '" + fileName + "'");
+  }
+
+  const std::vector<std::string> supportedTypes = {"value", "samples", "load_nif", "prefetch_nifs", "stop"};
+  std::vector<ControlEvent> script;
+  std::string line;
+  for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+    std::istringstream ss(line);
+    ControlEvent event;
+    if (!(ss >> event.seconds)) {
+      const auto first = line.find_first_not_of(" \t");
+      if (first == std::string::npos || line[first] == '#') {
+        continue;
+      }
+      throw std::runtime_error(fileName + ":" + std::to_string(lineNumber) + ": expected a time in seconds.");
+    }
+    ss >> event.type;
+    if (std::find(supportedTypes.begin(), supportedTypes.end(), event.type) == supportedTypes.end()) {
+      throw std::runtime_error(fileName + ":" + std::to_string(lineNumber) + ": unsupported control '" + event.type + "'");
+    }
+    std::getline(ss >> std::ws, event.value);
+    script.push_back(event);
+  }
+
+  std::stable_sort(script.begin(), script.end(),
+                   [](const ControlEvent& a, const ControlEvent& b) { return a.seconds < b.seconds; });
+  BOOST_LOG_TRIVIAL(info) << "Loaded " << script.size() << " control events from " << fileName;
+  return script;
+}
+
+void HeadlessClient::logFrames(const std::string& fileName) {
+  frameLog.open(fileName);
+  if (!frameLog) {
+    throw std::runtime_error("Could not open frame log '" + fileName + "'");
+  }
+  frameLog << "frame,time_s,interval_ms,packet_wait_ms,decode_ms,convert_ms,queue_depth,bytes_received\n";
+}
+
+void HeadlessClient::measureControlLatency(std::chrono::milliseconds interval) {
+  pingInterval = interval;
+}
+
+void HeadlessClient::runPings() {
+  using namespace std::chrono_literals;
+  auto due = std::chrono::steady_clock::now();
+  while (running) {
+    if (std::chrono::steady_clock::now() >= due) {
+      serialise(sender, "ping", microsecondsNow());
+      due += pingInterval;
+    }
+    std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(pingInterval, 10ms));
+  }
+}
+
+void HeadlessClient::send(const ControlEvent& event) {
+  BOOST_LOG_TRIVIAL(info) << "Scripted control: " << event.type << " " << event.value;
+  std::istringstream ss(event.value);
+  if (event.type == "value") {
+    float value = 0.f;
+    ss >> value;
+    serialise(sender, "value", value);
+  } else if (event.type == "samples") {
+    std::uint32_t samples = 1;
+    ss >> samples;
+    serialise(sender, "samples", samples);
+  } else if (event.type == "load_nif") {
+    serialise(sender, "load_nif", event.value);
+  } else if (event.type == "prefetch_nifs") {
+    std::vector<std::string> paths{std::istream_iterator<std::string>(ss), std::istream_iterator<std::string>()};
+    serialise(sender, "prefetch_nifs", paths);
+  } else if (event.type == "stop") {
+    serialise(sender, "stop", true);
+  }
+}
+
+void HeadlessClient::runScript(const std::vector<ControlEvent>& script,
+                               std::chrono::steady_clock::time_point startTime) {
+  using namespace std::chrono_literals;
+  for (const auto& event : script) {
+    const auto due = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::duration<double>(event.seconds));
+    // Sleep in short steps so that the client can exit promptly:
+    while (running && std::chrono::steady_clock::now() < due) {
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(due - std::chrono::steady_clock::now(), 10ms));
+    }
+    if (!running) {
+      return;
+    }
+    send(event);
+  }
+}
+
+bool HeadlessClient::run(const std::vector<ControlEvent>& script, std::chrono::seconds duration) {
+  using Clock = std::chrono::steady_clock;
+  using Ms = std::chrono::duration<double, std::milli>;
+  using namespace std::chrono_literals;
+
+  // Wait for the server to start streaming (this can take a while if it is busy initialising):
+  const auto waitStart = Clock::now();
+  while (!videoClient->waitForStream()) {
+    if (!videoClient->connected() || (duration.count() != 0 && Clock::now() - waitStart > duration)) {
+      BOOST_LOG_TRIVIAL(warning) << "Server did not start the video stream.";
+      return false;
+    }
+  }
+  if (!videoClient->initialiseVideoStream(5s)) {
+    BOOST_LOG_TRIVIAL(warning) << "Failed to initialise video stream.";
+    return false;
+  }
+  const auto w = videoClient->getFrameWidth();
+  const auto h = videoClient->getFrameHeight();
+  rgbBuffer.resize(w * h * 3);
+  BOOST_LOG_TRIVIAL(info) << "Headless client receiving " << w << "x" << h << " video.";
+
+  // Use the same per-stream names as the GUI client:
+  const auto prefix = videoClient->streamName() + "_";
+  auto& decodeTime = metrics::registry().histogram(prefix + "decode_ms");
+  auto& convertTime = metrics::registry().histogram(prefix + "colour_convert_ms");
+  auto& frameInterval = metrics::registry().histogram(prefix + "frame_interval_ms");
+  const auto& queueDepth = metrics::registry().gauge(prefix + "video_packet_queue_depth");
+  const auto& bytesReceived = metrics::registry().counter(prefix + "video_bytes_received");
+
+  const auto startTime = Clock::now();
+  running = true;
+  scriptThread.reset(new std::thread(&HeadlessClient::runScript, this, script, startTime));
+  if (pingInterval.count() > 0) {
+    pingThread.reset(new std::thread(&HeadlessClient::runPings, this));
+  }
+
+  std::uint64_t frames = 0;
+  auto lastFrameTime = startTime;
+  auto& timeToFirstFrame = metrics::registry().gauge(prefix + "time_to_first_frame_ms");
+  while (receiver.ok() && (duration.count() == 0 || Clock::now() - startTime < duration)) {
+    const auto frameStart = Clock::now();
+    double convertMs = 0.0;
+    bool extracted = false;
+    const bool gotFrame = videoClient->receiveVideoFrame([&](VideoDecoder& stream) {
+      // Convert as the GUI client would so that the CPU load is realistic:
+      const auto convertStart = Clock::now();
+      extracted = stream.extractRgb(rgbBuffer.data(), stream.frameWidth() * 3);
+      convertMs = Ms(Clock::now() - convertStart).count();
+    });
+    if (!gotFrame || !extracted) {
+      continue;
+    }
+
+    const auto frameEnd = Clock::now();
+    const double waitMs = videoClient->lastPacketWaitMs();
+    const double decodeMs = Ms(frameEnd - frameStart).count() - waitMs - convertMs;
+    const double intervalMs = Ms(frameEnd - lastFrameTime).count();
+    decodeTime.record(decodeMs);
+    convertTime.record(convertMs);
+    frameInterval.record(intervalMs);
+    lastFrameTime = frameEnd;
+    frames += 1;
+    if (frames == 1) {
+      timeToFirstFrame.set(Ms(frameEnd - waitStart).count());
+    }
+
+    if (frameLog.is_open()) {
+      frameLog << frames << "," << std::chrono::duration<double>(frameEnd - startTime).count() << ","
+               << intervalMs << "," << waitMs << "," << decodeMs << "," << convertMs << ","
+               << queueDepth.get() << "," << bytesReceived.get() << "\n";
+    }
+  }
+
+  running = false;
+  scriptThread->join();
+  scriptThread.reset();
+  if (pingThread) {
+    pingThread->join();
+    pingThread.reset();
+  }
+
+  const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+  BOOST_LOG_TRIVIAL(info) << "Headless client decoded " << frames << " frames in " << seconds << " seconds ("
+                          << frames / seconds << " fps, p99 frame interval " << frameInterval.quantile(0.99)
+                          << " ms, " << bytesReceived.get() << " bytes received).";
+  BOOST_LOG_TRIVIAL(info) << "Time to first frame: " << timeToFirstFrame.get() << " ms.";
+  if (controlRoundTrip.count() > 0) {
+    BOOST_LOG_TRIVIAL(info) << "Control round trip time over " << controlRoundTrip.count() << " pings: median "
+                            << controlRoundTrip.quantile(0.5) << " ms, p99 " << controlRoundTrip.quantile(0.99)
+                            << " ms, max " << controlRoundTrip.max() << " ms.";
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <PacketComms.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VideoClient.hpp"
+
+/// Runs the client comms, video decode and control stack without any
+/// windows or GL context so that many simulated clients can be run against
+/// a server (e.g. for soak or load testing on machines without a GPU).
+///
+/// Control changes can be scripted from a text file with one change per
+/// line in the form '<seconds> <type> [value]' where seconds is the time
+/// since the video stream started. Supported types are 'value', 'samples',
+/// 'load_nif', 'prefetch_nifs' (space separated paths) and 'stop'. Blank
+/// lines and lines starting with '#' are ignored.
+///
+/// The client can also measure control round trip time (e.g. under full
+/// video load) by sending pings to the server which replies immediately.
+class HeadlessClient {
+public:
+  struct ControlEvent {
+    double seconds;
+    std::string type;
+    std::string value;
+  };
+
+  /// @param videoReceiver Demuxer for video packets (the same as receiver unless video has its own connection).
+  HeadlessClient(PacketMuxer& sender, PacketDemuxer& receiver, PacketDemuxer& videoReceiver);
+  virtual ~HeadlessClient();
+
+  /// Parse a control script (throws std::runtime_error if it is invalid).
+  static std::vector<ControlEvent> loadScript(const std::string& fileName);
+
+  /// Optionally log timings for every decoded frame to a CSV file.
+  void logFrames(const std::string& fileName);
+
+  /// Send a ping at this interval while running and record the round trip
+  /// times in the "control_rtt_ms" histogram (zero disables pings).
+  void measureControlLatency(std::chrono::milliseconds interval);
+
+  /// Decode video until the duration has elapsed (or until the server
+  /// disconnects if duration is zero) while applying scripted controls.
+  /// @return true if the video stream could be initialised.
+  bool run(const std::vector<ControlEvent>& script, std::chrono::seconds duration);
+
+private:
+  void runScript(const std::vector<ControlEvent>& script, std::chrono::steady_clock::time_point startTime);
+  void send(const ControlEvent& event);
+  void runPings();
+
+  PacketMuxer& sender;
+  PacketDemuxer& receiver;
+  std::unique_ptr<VideoClient> videoClient;
+  PacketSubscription pongSubscription;
+  metrics::Histogram& controlRoundTrip;
+  std::chrono::milliseconds pingInterval;
+  std::vector<std::uint8_t> rgbBuffer;
+  std::ofstream frameLog;
+  std::atomic<bool> running;
+  std::unique_ptr<std::thread> scriptThread;
+  std::unique_ptr<std::thread> pingThread;
+};
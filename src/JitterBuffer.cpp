@@ -0,0 +1,168 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "JitterBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Playout delay in standard deviations of the arrival jitter:
+const double jitterDeviations = 3.0;
+
+// Longest playout delay (beyond this a stall is better than the latency):
+const double maxDelayUs = 250000.0;
+
+// Weight of each new sample in the variance estimate (RFC 3550 uses 1/16):
+const double varianceGain = 1.0 / 16.0;
+
+// Rate at which the delay shrinks once the jitter settles down:
+const double delayDecay = 1.0 / 64.0;
+
+// Rate at which the base transit time can drift up (e.g. the two clocks
+// run at slightly different rates or the route gets longer):
+const double transitDrift = 1.0 / 256.0;
+
+// Inter-frame gaps further out than this restart the estimates (e.g. the
+// server restarted or the stream was hidden):
+const std::int64_t resyncUs = 1000000;
+
+std::int64_t toUs(JitterBuffer::Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+} // end anonymous namespace
+
+JitterBuffer::JitterBuffer(std::size_t max, const std::string& metricsPrefix)
+    : maxFrames(max),
+      frameBytes(0),
+      shown(nullptr),
+      haveLast(false),
+      lastServerUs(0),
+      lastArrivalUs(0),
+      baseTransitUs(0.0),
+      varianceUs2(0.0),
+      delayUs(0.0),
+      delayGauge(metrics::registry().gauge(metricsPrefix + "jitter_buffer_ms")),
+      depthGauge(metrics::registry().gauge(metricsPrefix + "jitter_buffer_depth")),
+      droppedFrames(metrics::registry().counter(metricsPrefix + "jitter_dropped_frames_total")) {}
+
+JitterBuffer::~JitterBuffer() {}
+
+void JitterBuffer::resize(std::size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  frameBytes = bytes;
+  frames.clear();
+  freeFrames.clear();
+  queue.clear();
+  shown = nullptr;
+}
+
+void JitterBuffer::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto* frame : queue) {
+    release(frame);
+  }
+  queue.clear();
+  if (shown != nullptr) {
+    release(shown);
+    shown = nullptr;
+  }
+  haveLast = false;
+  varianceUs2 = 0.0;
+  delayUs = 0.0;
+  delayGauge.set(0.0);
+  depthGauge.set(0.0);
+}
+
+bool JitterBuffer::hasFreeSlot() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !freeFrames.empty() || frames.size() < maxFrames;
+}
+
+JitterBuffer::Frame* JitterBuffer::acquire() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (freeFrames.empty()) {
+    if (frames.size() == maxFrames) {
+      return nullptr;
+    }
+    frames.push_back(std::make_unique<Frame>());
+    frames.back()->pixels.resize(frameBytes);
+    return frames.back().get();
+  }
+  auto* frame = freeFrames.back();
+  freeFrames.pop_back();
+  return frame;
+}
+
+void JitterBuffer::push(Frame* frame, std::int64_t serverTimeUs, Clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const std::int64_t arrivalUs = toUs(arrival);
+  if (serverTimeUs == 0) {
+    serverTimeUs = arrivalUs;
+  }
+  const double transitUs = double(arrivalUs - serverTimeUs);
+
+  // Deviation of this frame's inter-arrival time from the server's interval:
+  const std::int64_t serverIntervalUs = serverTimeUs - lastServerUs;
+  const double deviationUs = double(arrivalUs - lastArrivalUs) - double(serverIntervalUs);
+  if (!haveLast || serverIntervalUs < 0 || serverIntervalUs > resyncUs || std::abs(deviationUs) > resyncUs) {
+    haveLast = true;
+    baseTransitUs = transitUs;
+    varianceUs2 = 0.0;
+  } else {
+    varianceUs2 += varianceGain * (deviationUs * deviationUs - varianceUs2);
+    baseTransitUs = transitUs < baseTransitUs ? transitUs : baseTransitUs + transitDrift * (transitUs - baseTransitUs);
+  }
+  lastServerUs = serverTimeUs;
+  lastArrivalUs = arrivalUs;
+
+  // Grow the delay straight away (late frames judder) but shrink it gradually
+  // (a smaller delay compresses the schedule, which also judders):
+  const double targetUs = std::min(jitterDeviations * std::sqrt(varianceUs2), maxDelayUs);
+  delayUs = targetUs > delayUs ? targetUs : delayUs + delayDecay * (targetUs - delayUs);
+  delayGauge.set(delayUs / 1000.0);
+
+  // Keep frames in order even if the schedule moves backwards:
+  const auto scheduled = Clock::time_point(std::chrono::microseconds(serverTimeUs + std::int64_t(baseTransitUs + delayUs)));
+  frame->presentTime = queue.empty() ? scheduled : std::max(scheduled, queue.back()->presentTime);
+  queue.push_back(frame);
+  depthGauge.set(queue.size());
+}
+
+JitterBuffer::Frame* JitterBuffer::present(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Frame* due = nullptr;
+  while (!queue.empty() && queue.front()->presentTime <= now) {
+    if (due != nullptr) {
+      // The UI missed this frame's slot (e.g. a slow redraw):
+      release(due);
+      droppedFrames.add();
+    }
+    due = queue.front();
+    queue.pop_front();
+  }
+  if (due == nullptr) {
+    return nullptr;
+  }
+  if (shown != nullptr) {
+    release(shown);
+  }
+  shown = due;
+  depthGauge.set(queue.size());
+  return shown;
+}
+
+bool JitterBuffer::pending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !queue.empty();
+}
+
+double JitterBuffer::delayMs() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return delayUs / 1000.0;
+}
+
+void JitterBuffer::release(Frame* frame) {
+  freeFrames.push_back(frame);
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include "Metrics.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Holds decoded frames back so that they can be shown at the even rate
+/// the server sent them instead of whenever they happen to arrive. Each
+/// frame is scheduled for its server timestamp plus the lowest transit
+/// time seen so far plus a playout delay. The delay is a multiple of the
+/// standard deviation of the difference between the inter-arrival time
+/// and the server's inter-frame time (as in RFC 3550's jitter estimate) so
+/// it grows as soon as delivery gets burstier and shrinks slowly when it
+/// settles down.
+///
+/// Frames are copied into a small pool of slots that is allocated as it is
+/// needed. push() is called by the decode threads and present() by the UI
+/// thread: the frame returned by present() stays valid until the next call
+/// to present() or reset().
+class JitterBuffer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    std::vector<std::uint8_t> pixels;
+    bool valueKnown = false;
+    float value = 0.f;  // Control value the frame was rendered with.
+    Clock::time_point presentTime;
+  };
+
+  /// @param metricsPrefix Prefix of the buffer's metric names (e.g. the stream name).
+  JitterBuffer(std::size_t maxFrames, const std::string& metricsPrefix);
+  virtual ~JitterBuffer();
+
+  /// Set the size of frames (drops any queued frames).
+  void resize(std::size_t frameBytes);
+
+  /// Drop all frames and forget the timing history.
+  void reset();
+
+  /// True if acquire() would succeed.
+  bool hasFreeSlot() const;
+
+  /// A slot to copy a frame into, or nullptr if every slot is in use.
+  Frame* acquire();
+
+  /// Schedule a frame that was acquired and filled. serverTimeUs is the time
+  /// the server sent it on the server's clock (if it is 0 the arrival time is
+  /// used so frames are only smoothed by the playout delay).
+  void push(Frame* frame, std::int64_t serverTimeUs, Clock::time_point arrival);
+
+  /// The newest frame that is due at time now (older due frames are dropped)
+  /// or nullptr if no new frame is due.
+  Frame* present(Clock::time_point now);
+
+  /// True if there are frames waiting to be shown.
+  bool pending() const;
+
+  double delayMs() const;
+
+private:
+  void release(Frame* frame);
+
+  const std::size_t maxFrames;
+  mutable std::mutex mutex;
+  std::size_t frameBytes;
+  std::vector<std::unique_ptr<Frame>> frames;
+  std::vector<Frame*> freeFrames;
+  std::deque<Frame*> queue;
+  Frame* shown;
+
+  // Timing estimates (all in microseconds):
+  bool haveLast;
+  std::int64_t lastServerUs;
+  std::int64_t lastArrivalUs;
+  double baseTransitUs;
+  double varianceUs2;
+  double delayUs;
+
+  metrics::Gauge& delayGauge;
+  metrics::Gauge& depthGauge;
+  metrics::Counter& droppedFrames;
+};
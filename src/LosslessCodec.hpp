@@ -0,0 +1,109 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// A very cheap lossless video codec for fast local networks where CPU time
+/// matters more than bandwidth. Each frame is the XOR difference from the
+/// previous frame coded as alternating runs of unchanged bytes and literal
+/// bytes. Static areas cost almost nothing and the encoder does no
+/// transforms or motion search so it runs at memory bandwidth.
+///
+/// Each frame on the wire is a Header followed by header.payloadSize bytes of
+/// tokens. A token is two 32-bit counts (unchanged bytes, literal bytes)
+/// followed by the literal bytes. Pixels are 8-bit BGR.
+namespace lossless {
+
+const std::uint32_t magic = 0x4c495552; // "RUIL"
+
+struct Header {
+  std::uint32_t magic;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t keyFrame;     // Non-zero if the frame does not depend on the previous one.
+  std::uint32_t payloadSize;
+};
+
+/// Bytes of the previous frame are only skipped once at least this many
+/// consecutive bytes are unchanged (shorter runs cost more as tokens).
+const std::size_t minRun = 8;
+
+/// Largest frame size a decoder accepts if it was not told the size.
+const std::uint32_t maxDimension = 16384;
+
+/// Largest payload encodeDelta() can produce for size bytes. Every token
+/// after the first skips at least minRun bytes so there are at most
+/// size / minRun + 1 of them.
+inline std::size_t maxPayloadSize(std::size_t size) {
+  return size + 2 * sizeof(std::uint32_t) * (size / minRun + 2);
+}
+
+/// Append tokens that turn previous into current to out.
+/// Both buffers are contiguous and size bytes long.
+inline void encodeDelta(const std::uint8_t* current, const std::uint8_t* previous, std::size_t size,
+                        std::vector<std::uint8_t>& out) {
+  auto appendCount = [&](std::uint32_t count) {
+    const auto offset = out.size();
+    out.resize(offset + sizeof(count));
+    std::memcpy(out.data() + offset, &count, sizeof(count));
+  };
+  auto unchanged = [&](std::size_t i) {
+    return i + minRun <= size && std::memcmp(current + i, previous + i, minRun) == 0;
+  };
+
+  std::size_t i = 0;
+  while (i < size) {
+    // Skip unchanged bytes (a word at a time where possible):
+    const std::size_t runStart = i;
+    while (i + minRun <= size && std::memcmp(current + i, previous + i, minRun) == 0) {
+      i += minRun;
+    }
+    while (i < size && current[i] == previous[i]) {
+      i += 1;
+    }
+    const std::size_t run = i - runStart;
+
+    // Gather changed bytes until the next unchanged run:
+    const std::size_t literalStart = i;
+    while (i < size && !unchanged(i)) {
+      i += 1;
+    }
+    const std::size_t literals = i - literalStart;
+
+    appendCount(run);
+    appendCount(literals);
+    const auto offset = out.size();
+    out.resize(offset + literals);
+    for (std::size_t l = 0; l < literals; ++l) {
+      out[offset + l] = current[literalStart + l] ^ previous[literalStart + l];
+    }
+  }
+}
+
+/// Apply tokens produced by encodeDelta() to frame (in place).
+/// @return false if the tokens are malformed.
+inline bool decodeDelta(const std::uint8_t* tokens, std::size_t tokenSize, std::uint8_t* frame, std::size_t size) {
+  std::size_t t = 0;
+  std::size_t i = 0;
+  while (t + 2 * sizeof(std::uint32_t) <= tokenSize) {
+    std::uint32_t run, literals;
+    std::memcpy(&run, tokens + t, sizeof(run));
+    std::memcpy(&literals, tokens + t + sizeof(run), sizeof(literals));
+    t += 2 * sizeof(std::uint32_t);
+    i += run;
+    if (i + literals > size || t + literals > tokenSize) {
+      return false;
+    }
+    for (std::uint32_t l = 0; l < literals; ++l) {
+      frame[i + l] ^= tokens[t + l];
+    }
+    i += literals;
+    t += literals;
+  }
+  return t == tokenSize && i <= size;
+}
+
+} // end namespace lossless
@@ -0,0 +1,302 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// A lightweight registry of named performance metrics. Updating a metric
+/// is lock-free (relaxed atomics only) so metrics can be updated from any
+/// thread on hot paths. Looking a metric up by name takes a lock, so hot
+/// paths should look up once and keep the reference (references remain
+/// valid for the lifetime of the registry).
+namespace metrics {
+
+namespace detail {
+
+inline void atomicAdd(std::atomic<double>& target, double value) {
+  double expected = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed)) {}
+}
+
+inline void atomicMax(std::atomic<double>& target, double value) {
+  double expected = target.load(std::memory_order_relaxed);
+  while (value > expected && !target.compare_exchange_weak(expected, value, std::memory_order_relaxed)) {}
+}
+
+} // end namespace detail
+
+/// Monotonically increasing count (e.g. bytes received).
+class Counter {
+public:
+  void add(std::uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::uint64_t> value{0};
+};
+
+/// Instantaneous value (e.g. a queue depth).
+class Gauge {
+public:
+  void set(double v) { value.store(v, std::memory_order_relaxed); }
+  double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<double> value{0.0};
+};
+
+/// Exponentially weighted moving average of a noisy signal (e.g. frame rate).
+class SmoothedGauge {
+public:
+  SmoothedGauge(double smoothing = 0.1) : alpha(smoothing) {}
+
+  void update(double sample) {
+    if (!std::isfinite(sample)) {
+      return;
+    }
+    double expected = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(expected, (1.0 - alpha) * expected + alpha * sample,
+                                        std::memory_order_relaxed)) {}
+  }
+
+  double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  const double alpha;
+  std::atomic<double> value{0.0};
+};
+
+/// Distribution of a value (e.g. a duration in milliseconds) in power of
+/// two buckets, plus a ring buffer of the most recent values for graphing.
+class Histogram {
+public:
+  static constexpr std::size_t bucketCount = 40;
+  static constexpr int smallestExponent = -16; // Upper bound of the first bucket is 2^-16.
+  static constexpr std::size_t historySize = 256;
+
+  void record(double v) {
+    if (!std::isfinite(v) || v < 0.0) {
+      return;
+    }
+    buckets[bucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    detail::atomicAdd(total, v);
+    detail::atomicMax(maximum, v);
+    const auto n = samples.fetch_add(1, std::memory_order_relaxed);
+    recent[n % historySize].store(float(v), std::memory_order_relaxed);
+  }
+
+  std::uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+  double sum() const { return total.load(std::memory_order_relaxed); }
+  double max() const { return maximum.load(std::memory_order_relaxed); }
+  double mean() const {
+    const auto n = count();
+    return n ? sum() / n : 0.0;
+  }
+
+  /// Upper bound of the bucket containing quantile q in [0, 1].
+  double quantile(double q) const {
+    std::array<std::uint64_t, bucketCount> counts;
+    std::uint64_t n = 0;
+    for (std::size_t b = 0; b < bucketCount; ++b) {
+      counts[b] = buckets[b].load(std::memory_order_relaxed);
+      n += counts[b];
+    }
+    const double target = q * n;
+    std::uint64_t cumulative = 0;
+    for (std::size_t b = 0; b < bucketCount; ++b) {
+      cumulative += counts[b];
+      if (n && cumulative >= target) {
+        return std::min(bucketUpperBound(b), max());
+      }
+    }
+    return 0.0;
+  }
+
+  static double bucketUpperBound(std::size_t b) {
+    return std::ldexp(1.0, int(b) + smallestExponent);
+  }
+
+  std::uint64_t bucketCountAt(std::size_t b) const { return buckets[b].load(std::memory_order_relaxed); }
+
+  /// Most recent values, oldest first.
+  std::vector<float> history() const {
+    const auto n = count();
+    const auto size = std::min<std::uint64_t>(n, historySize);
+    std::vector<float> values;
+    values.reserve(size);
+    for (auto i = n - size; i < n; ++i) {
+      values.push_back(recent[i % historySize].load(std::memory_order_relaxed));
+    }
+    return values;
+  }
+
+  /// Most recent value (0 if nothing has been recorded).
+  float latest() const {
+    const auto n = count();
+    return n ? recent[(n - 1) % historySize].load(std::memory_order_relaxed) : 0.f;
+  }
+
+private:
+  static std::size_t bucketIndex(double v) {
+    int exponent = 0;
+    std::frexp(v, &exponent); // v = m * 2^exponent with m in [0.5, 1) so v < 2^exponent.
+    const int b = exponent - smallestExponent;
+    return std::size_t(std::clamp(b, 0, int(bucketCount) - 1));
+  }
+
+  std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+  std::array<std::atomic<float>, historySize> recent{};
+  std::atomic<std::uint64_t> samples{0};
+  std::atomic<double> total{0.0};
+  std::atomic<double> maximum{0.0};
+};
+
+class Registry {
+public:
+  Counter& counter(const std::string& name) { return get(counters, name); }
+  Gauge& gauge(const std::string& name) { return get(gauges, name); }
+  SmoothedGauge& smoothed(const std::string& name) { return get(smoothedGauges, name); }
+  Histogram& histogram(const std::string& name) { return get(histograms, name); }
+
+  /// Write one row per metric with a header row.
+  void writeCsv(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    os << "name,type,value,count,mean,p50,p90,p99,max\n";
+    for (const auto& c : counters) {
+      os << c.first << ",counter," << c.second->get() << ",,,,,,\n";
+    }
+    for (const auto& g : gauges) {
+      os << g.first << ",gauge," << g.second->get() << ",,,,,,\n";
+    }
+    for (const auto& g : smoothedGauges) {
+      os << g.first << ",smoothed," << g.second->get() << ",,,,,,\n";
+    }
+    for (const auto& h : histograms) {
+      const auto& v = *h.second;
+      os << h.first << ",histogram," << v.latest() << "," << v.count() << "," << v.mean() << ","
+         << v.quantile(0.5) << "," << v.quantile(0.9) << "," << v.quantile(0.99) << "," << v.max() << "\n";
+    }
+  }
+
+  /// Write all metrics (including histogram buckets) as a JSON object.
+  void writeJson(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const char* separator = "";
+    os << "{\n  \"counters\": {";
+    for (const auto& c : counters) {
+      os << separator << "\n    \"" << c.first << "\": " << c.second->get();
+      separator = ",";
+    }
+    separator = "";
+    os << "\n  },\n  \"gauges\": {";
+    for (const auto& g : gauges) {
+      os << separator << "\n    \"" << g.first << "\": " << g.second->get();
+      separator = ",";
+    }
+    for (const auto& g : smoothedGauges) {
+      os << separator << "\n    \"" << g.first << "\": " << g.second->get();
+      separator = ",";
+    }
+    separator = "";
+    os << "\n  },\n  \"histograms\": {";
+    for (const auto& h : histograms) {
+      const auto& v = *h.second;
+      os << separator << "\n    \"" << h.first << "\": {"
+         << "\"count\": " << v.count() << ", \"mean\": " << v.mean()
+         << ", \"p50\": " << v.quantile(0.5) << ", \"p90\": " << v.quantile(0.9)
+         << ", \"p99\": " << v.quantile(0.99) << ", \"max\": " << v.max() << ", \"buckets\": [";
+      const char* bucketSeparator = "";
+      for (std::size_t b = 0; b < Histogram::bucketCount; ++b) {
+        if (v.bucketCountAt(b)) {
+          os << bucketSeparator << "[" << Histogram::bucketUpperBound(b) << ", " << v.bucketCountAt(b) << "]";
+          bucketSeparator = ", ";
+        }
+      }
+      os << "]}";
+      separator = ",";
+    }
+    os << "\n  }\n}\n";
+  }
+
+  /// Write all metrics in the Prometheus text exposition format. Each
+  /// name is prefixed with prefix. Histograms are exported with cumulative
+  /// buckets so percentiles can be computed by the scraper.
+  void writePrometheus(std::ostream& os, const std::string& prefix = "") const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& c : counters) {
+      os << "# TYPE " << prefix << c.first << " counter\n" << prefix << c.first << " " << c.second->get() << "\n";
+    }
+    for (const auto& g : gauges) {
+      os << "# TYPE " << prefix << g.first << " gauge\n" << prefix << g.first << " " << g.second->get() << "\n";
+    }
+    for (const auto& g : smoothedGauges) {
+      os << "# TYPE " << prefix << g.first << " gauge\n" << prefix << g.first << " " << g.second->get() << "\n";
+    }
+    for (const auto& h : histograms) {
+      const auto& v = *h.second;
+      const auto name = prefix + h.first;
+      os << "# TYPE " << name << " histogram\n";
+      std::uint64_t cumulative = 0;
+      for (std::size_t b = 0; b < Histogram::bucketCount; ++b) {
+        cumulative += v.bucketCountAt(b);
+        // Bounds are powers of two so this precision prints them exactly:
+        std::ostringstream bound;
+        bound << std::setprecision(12) << Histogram::bucketUpperBound(b);
+        os << name << "_bucket{le=\"" << bound.str() << "\"} " << cumulative << "\n";
+      }
+      os << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+      os << name << "_sum " << v.sum() << "\n";
+      os << name << "_count " << cumulative << "\n";
+    }
+  }
+
+private:
+  template <class Metric>
+  Metric& get(std::map<std::string, std::unique_ptr<Metric>>& metrics, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& metric = metrics[name];
+    if (!metric) {
+      metric.reset(new Metric());
+    }
+    return *metric;
+  }
+
+  mutable std::mutex mutex;
+  std::map<std::string, std::unique_ptr<Counter>> counters;
+  std::map<std::string, std::unique_ptr<Gauge>> gauges;
+  std::map<std::string, std::unique_ptr<SmoothedGauge>> smoothedGauges;
+  std::map<std::string, std::unique_ptr<Histogram>> histograms;
+};
+
+/// The process wide registry.
+inline Registry& registry() {
+  static Registry instance;
+  return instance;
+}
+
+/// Records the lifetime of the object in milliseconds.
+class ScopedTimer {
+public:
+  ScopedTimer(Histogram& h) : histogram(h), start(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() {
+    histogram.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+
+private:
+  Histogram& histogram;
+  std::chrono::steady_clock::time_point start;
+};
+
+} // end namespace metrics
@@ -0,0 +1,88 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "MetricsOverlay.hpp"
+
+#include <cstdio>
+
+namespace {
+
+std::string label(const std::string& name, const std::string& prefix) {
+  return name.compare(0, prefix.size(), prefix) == 0 ? name.substr(prefix.size()) : name;
+}
+
+} // end anonymous namespace
+
+MetricsOverlay::MetricsOverlay(metrics::Registry& registry,
+                               const std::vector<std::string>& histogramNames,
+                               const std::vector<std::string>& gaugeNames,
+                               const std::string& labelPrefix) {
+  for (const auto& name : histogramNames) {
+    histograms.emplace_back(label(name, labelPrefix), &registry.histogram(name));
+  }
+  for (const auto& name : gaugeNames) {
+    gauges.emplace_back(label(name, labelPrefix), &registry.gauge(name));
+  }
+}
+
+void MetricsOverlay::draw(NVGcontext* ctx, const nanogui::Vector2i& pos, const nanogui::Vector2i& size) const {
+  const float margin = 8.f;
+  const float textHeight = 14.f;
+  const float graphWidth = std::min(256.f, size.x() - 2 * margin);
+  const float graphHeight = 40.f;
+  float x = pos.x() + margin;
+  float y = pos.y() + margin;
+  char text[128];
+
+  nvgSave(ctx);
+  nvgFontSize(ctx, textHeight);
+  nvgFontFace(ctx, "sans");
+  nvgTextAlign(ctx, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+
+  for (const auto& h : histograms) {
+    const auto values = h.second->history();
+    const float peak = std::max(1e-3f, values.empty() ? 0.f : *std::max_element(values.begin(), values.end()));
+
+    nvgBeginPath(ctx);
+    nvgRect(ctx, x, y, graphWidth, graphHeight + textHeight);
+    nvgFillColor(ctx, nvgRGBA(0, 0, 0, 160));
+    nvgFill(ctx);
+
+    if (values.size() > 1) {
+      const float dx = graphWidth / (metrics::Histogram::historySize - 1);
+      const float x0 = x + graphWidth - dx * (values.size() - 1);
+      const float base = y + textHeight + graphHeight;
+      nvgBeginPath(ctx);
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        const float px = x0 + i * dx;
+        const float py = base - graphHeight * values[i] / peak;
+        if (i == 0) {
+          nvgMoveTo(ctx, px, py);
+        } else {
+          nvgLineTo(ctx, px, py);
+        }
+      }
+      nvgStrokeColor(ctx, nvgRGBA(64, 255, 128, 255));
+      nvgStrokeWidth(ctx, 1.f);
+      nvgStroke(ctx);
+    }
+
+    std::snprintf(text, sizeof(text), "%s: %.2f (p90 %.2f, max %.2f)",
+                  h.first.c_str(), h.second->latest(), h.second->quantile(0.9), peak);
+    nvgFillColor(ctx, nvgRGBA(255, 255, 255, 255));
+    nvgText(ctx, x + 2, y, text, nullptr);
+    y += graphHeight + textHeight + margin;
+  }
+
+  for (const auto& g : gauges) {
+    nvgBeginPath(ctx);
+    nvgRect(ctx, x, y, graphWidth, textHeight);
+    nvgFillColor(ctx, nvgRGBA(0, 0, 0, 160));
+    nvgFill(ctx);
+    std::snprintf(text, sizeof(text), "%s: %.2f", g.first.c_str(), g.second->get());
+    nvgFillColor(ctx, nvgRGBA(255, 255, 255, 255));
+    nvgText(ctx, x + 2, y, text, nullptr);
+    y += textHeight;
+  }
+
+  nvgRestore(ctx);
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <nanogui/nanogui.h>
+
+#include "Metrics.hpp"
+
+/// Draws a graph of the recent history of each selected histogram and the
+/// value of each selected gauge. Intended to be drawn over the top of the
+/// video preview. Names that start with labelPrefix (e.g. the stream name)
+/// are shown without it.
+class MetricsOverlay {
+public:
+  MetricsOverlay(metrics::Registry& registry,
+                 const std::vector<std::string>& histogramNames,
+                 const std::vector<std::string>& gaugeNames,
+                 const std::string& labelPrefix = std::string());
+
+  void draw(NVGcontext* ctx, const nanogui::Vector2i& pos, const nanogui::Vector2i& size) const;
+
+private:
+  std::vector<std::pair<std::string, const metrics::Histogram*>> histograms;
+  std::vector<std::pair<std::string, const metrics::Gauge*>> gauges;
+};
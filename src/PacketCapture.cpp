@@ -0,0 +1,201 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "PacketCapture.hpp"
+#include "PacketDescriptions.hpp"
+
+#include <PacketSerialisation.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <cstring>
+
+namespace {
+
+const char captureMagic[8] = {'R', 'U', 'I', 'C', 'A', 'P', 'T', 'R'};
+const std::uint32_t captureVersion = 1;
+
+std::size_t paddedSize(std::size_t size) {
+  return (size + 7) & ~std::size_t(7);
+}
+
+} // end anonymous namespace
+
+PacketRecorder::PacketRecorder(PacketDemuxer& demuxer, const std::vector<std::string>& packetTypes, const std::string& fileName)
+    : buffer(4 * 1024 * 1024),
+      startTime(std::chrono::steady_clock::now()),
+      recordCount(0) {
+  file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  file.open(fileName, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Could not open capture file '" + fileName + "' for writing.");
+  }
+
+  capture::FileHeader header;
+  std::memcpy(header.magic, captureMagic, sizeof(header.magic));
+  header.version = captureVersion;
+  header.reserved = 0;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (const auto& type : packetTypes) {
+    subs.push_back(demuxer.subscribe(type, [this, type](const ComPacket::ConstSharedPacket& packet) {
+      write(type, packet);
+    }));
+  }
+  BOOST_LOG_TRIVIAL(info) << "Recording packets to " << fileName;
+}
+
+PacketRecorder::~PacketRecorder() {
+  // Unsubscribe before closing the file so no more writes can happen:
+  subs.clear();
+  std::lock_guard<std::mutex> lock(fileMutex);
+  file.close();
+  BOOST_LOG_TRIVIAL(info) << "Recorded " << recordCount << " packets.";
+}
+
+void PacketRecorder::write(const std::string& type, const ComPacket::ConstSharedPacket& packet) {
+  const auto elapsed = std::chrono::steady_clock::now() - startTime;
+  capture::RecordHeader header;
+  header.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  header.payloadSize = packet->getDataSize();
+  header.typeSize = type.size();
+  header.reserved = 0;
+
+  const std::size_t unpadded = sizeof(header) + header.typeSize + header.payloadSize;
+  const char padding[8] = {0};
+
+  std::lock_guard<std::mutex> lock(fileMutex);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(type.data(), type.size());
+  file.write(reinterpret_cast<const char*>(packet->getData().data()), header.payloadSize);
+  file.write(padding, paddedSize(unpadded) - unpadded);
+  recordCount += 1;
+}
+
+PacketCaptureReader::PacketCaptureReader(const std::string& fileName)
+    : offset(0) {
+  namespace ipc = boost::interprocess;
+  try {
+    file = ipc::file_mapping(fileName.c_str(), ipc::read_only);
+    region = ipc::mapped_region(file, ipc::read_only);
+  } catch (const ipc::interprocess_exception& e) {
+    throw std::runtime_error("Could not map capture file '" + fileName + "': " + e.what());
+  }
+
+  capture::FileHeader header;
+  if (region.get_size() < sizeof(header)) {
+    throw std::runtime_error("Capture file '" + fileName + "' is too small.");
+  }
+  std::memcpy(&header, region.get_address(), sizeof(header));
+  if (std::memcmp(header.magic, captureMagic, sizeof(header.magic)) != 0 || header.version != captureVersion) {
+    throw std::runtime_error("File '" + fileName + "' is not a supported packet capture.");
+  }
+  region.advise(ipc::mapped_region::advice_sequential);
+  rewind();
+}
+
+void PacketCaptureReader::rewind() {
+  offset = sizeof(capture::FileHeader);
+}
+
+bool PacketCaptureReader::next(capture::Record& record) {
+  const auto* base = static_cast<const std::uint8_t*>(region.get_address());
+  const std::size_t size = region.get_size();
+
+  capture::RecordHeader header;
+  if (offset + sizeof(header) > size) {
+    return false;
+  }
+  std::memcpy(&header, base + offset, sizeof(header));
+  const std::size_t unpadded = sizeof(header) + header.typeSize + header.payloadSize;
+  if (offset + unpadded > size) {
+    BOOST_LOG_TRIVIAL(warning) << "Capture ends with a truncated record.";
+    return false;
+  }
+
+  const auto* typeName = reinterpret_cast<const char*>(base + offset + sizeof(header));
+  record.timestamp = std::chrono::nanoseconds(header.timestampNs);
+  record.type.assign(typeName, header.typeSize);
+  record.payload = base + offset + sizeof(header) + header.typeSize;
+  record.payloadSize = header.payloadSize;
+  offset += paddedSize(unpadded);
+  return true;
+}
+
+PacketReplayServer::PacketReplayServer(const std::string& captureFile, int portNumber, bool asFastAsPossible)
+    : fileName(captureFile),
+      port(portNumber),
+      fast(asFastAsPossible),
+      listening(false),
+      running(true) {
+  // Open the capture here so that errors are reported to the caller:
+  PacketCaptureReader check(fileName);
+  thread.reset(new std::thread(&PacketReplayServer::serve, this));
+}
+
+PacketReplayServer::~PacketReplayServer() {
+  running = false;
+  if (thread) {
+    thread->join();
+  }
+}
+
+void PacketReplayServer::waitUntilListening() {
+  using namespace std::chrono_literals;
+  while (!listening) {
+    std::this_thread::sleep_for(5ms);
+  }
+}
+
+void PacketReplayServer::serve() {
+  using namespace std::chrono_literals;
+  bool ok = serverSocket.Bind(port);
+  if (ok) {
+    ok = serverSocket.Listen(0);
+  }
+  listening = true;
+  if (!ok) {
+    BOOST_LOG_TRIVIAL(error) << "Replay server could not listen on port " << port;
+    return;
+  }
+
+  BOOST_LOG_TRIVIAL(info) << "Replay server accepting connections on port " << port;
+  auto connection = serverSocket.Accept();
+  if (!connection) {
+    BOOST_LOG_TRIVIAL(error) << "Replay server failed to accept a connection.";
+    return;
+  }
+  connection->setBlocking(false);
+  PacketDemuxer receiver(*connection, packets::packetTypes);
+  PacketMuxer sender(*connection, packets::packetTypes);
+  std::atomic<bool> stopped(false);
+  auto stopSubscription = receiver.subscribe("stop", [&](const ComPacket::ConstSharedPacket&) {
+    stopped = true;
+  });
+  syncWithClient(sender, receiver, "ready");
+
+  PacketCaptureReader reader(fileName);
+  capture::Record record;
+  std::uint64_t count = 0;
+  const auto startTime = std::chrono::steady_clock::now();
+  while (running && !stopped && receiver.ok() && reader.next(record)) {
+    // The sync handshake was live so is not replayed:
+    if (record.type == "ready") {
+      continue;
+    }
+    if (!fast) {
+      std::this_thread::sleep_until(startTime + record.timestamp);
+    }
+    sender.emplacePacket(record.type,
+                         reinterpret_cast<VectorStream::CharType*>(const_cast<std::uint8_t*>(record.payload)),
+                         record.payloadSize);
+    count += 1;
+  }
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  BOOST_LOG_TRIVIAL(info) << "Replayed " << count << " packets in " << seconds << " seconds.";
+
+  // Keep the connection open until the client is finished with it:
+  while (running && !stopped && receiver.ok()) {
+    std::this_thread::sleep_for(5ms);
+  }
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <PacketComms.h>
+#include <network/TcpSocket.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Capture files are a fixed header followed by an append-only sequence of
+/// records. Each record is a RecordHeader, the packet type name and then the
+/// packet payload, padded so that every record starts on an 8 byte boundary.
+/// This means a capture can be memory mapped and read in place.
+namespace capture {
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t reserved;
+};
+
+struct RecordHeader {
+  std::uint64_t timestampNs; // Time since the start of the capture.
+  std::uint32_t payloadSize;
+  std::uint16_t typeSize;
+  std::uint16_t reserved;
+};
+
+/// A record read in place from a mapped capture.
+struct Record {
+  std::chrono::nanoseconds timestamp;
+  std::string type;
+  const std::uint8_t* payload;
+  std::uint32_t payloadSize;
+};
+
+} // end namespace capture
+
+/// Subscribes to every packet type on a demuxer and appends each packet
+/// received to a capture file. Writes are buffered so recording does not
+/// slow down the comms thread significantly.
+class PacketRecorder {
+public:
+  PacketRecorder(PacketDemuxer& demuxer, const std::vector<std::string>& packetTypes, const std::string& fileName);
+  virtual ~PacketRecorder();
+
+private:
+  void write(const std::string& type, const ComPacket::ConstSharedPacket& packet);
+
+  std::vector<char> buffer;
+  std::ofstream file;
+  std::mutex fileMutex;
+  std::chrono::steady_clock::time_point startTime;
+  std::uint64_t recordCount;
+  std::vector<PacketSubscription> subs;
+};
+
+/// Reads records from a memory mapped capture file.
+class PacketCaptureReader {
+public:
+  PacketCaptureReader(const std::string& fileName);
+
+  /// Read the next record (payload points into the mapped file).
+  /// @return false at the end of the capture.
+  bool next(capture::Record& record);
+
+  /// Restart reading from the first record.
+  void rewind();
+
+private:
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+  std::size_t offset;
+};
+
+/// Serves a recorded capture to a client as though it were a live
+/// server, so the normal client code paths (VideoClient, ControlsForm
+/// subscribers etc.) can be exercised without a renderer. Packets are
+/// sent at the recorded pace or, optionally, as fast as possible.
+class PacketReplayServer {
+public:
+  PacketReplayServer(const std::string& fileName, int port, bool asFastAsPossible);
+  virtual ~PacketReplayServer();
+
+  /// Block until the server is listening for a connection.
+  void waitUntilListening();
+
+private:
+  void serve();
+
+  std::string fileName;
+  int port;
+  bool fast;
+  std::atomic<bool> listening;
+  std::atomic<bool> running;
+  TcpSocket serverSocket;
+  std::unique_ptr<std::thread> thread;
+};
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <cereal/types/string.hpp>
@@ -16,6 +18,178 @@ const std::vector<std::string> packetTypes {
     "render_preview",      // used to send compressed video packets
                            // for render preview (server -> client)
     "ready",               // Used to sync with the other side once all other subscribers are ready (bi-directional)
+    "samples",             // Set the number of samples per pixel per render pass (client -> server)
+    "sample_stats",        // Progressive accumulation statistics (server -> client)
+    "load_nif",            // Select the NIF asset to render by its path on the server (client -> server)
+    "prefetch_nifs",       // Hint which NIF assets are likely to be selected next (client -> server)
+    "nif_status",          // Load progress of the selected NIF asset (server -> client)
+    "thumbnail_request",   // Request a thumbnail atlas for a list of thumbnail paths (client -> server)
+    "thumbnail_atlas",     // Encoded thumbnail atlas (server -> client)
+    "video_stream",        // Announce a named video stream before its first packet (server -> client)
+    "stream_visibility",   // Show or hide a video stream so the server can pause it (client -> server)
+    "albedo_preview",      // Compressed video packets for additional named streams (server -> client)
+    "normals_preview",
+    "heatmap_preview",
+    "stream_info",         // Codec and frame size of a video stream, sent before its first packet (server -> client)
+    "ping",                // Request an immediate "pong" echoing the same payload, to measure control latency (client -> server)
+    "pong",                // Reply to a "ping" (server -> client)
+    "frame_info",          // Frame ID and the control value it was rendered with, sent before each video frame (server -> client)
+    "server_info",         // Server's host name (server -> client, once after connecting)
+    "client_info",         // Client's host name and whether video can use shared memory (client -> server reply to "server_info")
+    "tile_assignment",     // Band of the image the server renders when a client stitches several servers' video (client -> server, before "client_info")
+};
+
+/// The packet types that can carry a video stream. The server may send any
+/// subset of these (announcing each one with a "video_stream" packet).
+const std::vector<std::string> videoStreams {
+    "render_preview",
+    "albedo_preview",
+    "normals_preview",
+    "heatmap_preview",
+};
+
+/// True for packets that are sent on the video connection when the client
+/// connects one: video data and stream_info/frame_info, which must stay in
+/// order with it. Everything else stays on the main connection.
+inline bool isVideoPacket(const std::string& packetType) {
+  return packetType == "stream_info" || packetType == "frame_info" ||
+         std::find(videoStreams.begin(), videoStreams.end(), packetType) != videoStreams.end();
+}
+
+/// Describes how a video stream is encoded.
+struct StreamInfo {
+  std::string stream;
+  std::string codec = "libav";  // Name of the backend needed to decode it (see createVideoDecoder()).
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  /// "srgb" for display-ready images or "log" for log-encoded HDR that the
+  /// client tone maps (see ToneMapping.hpp) using the stop range below.
+  std::string transfer = "srgb";
+  float logMinStop = -8.f;
+  float logMaxStop = 8.f;
+  std::string sharedMemory;     // Name of the SharedFrameRing if the codec is "shm".
+  std::uint32_t tileTop = 0;    // First row of the full image in this stream (see TileAssignment).
+  std::uint32_t fullHeight = 0; // Height of the full image if the stream is one band of it (0 if not).
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(stream, codec, width, height, transfer, logMinStop, logMaxStop, sharedMemory, tileTop, fullHeight);
+  }
+};
+
+/// Exchanged when a client connects so that a client on the same host as
+/// the server can receive video through shared memory instead of encoding it.
+struct HostInfo {
+  std::string hostName;
+  bool sharedMemory = false; // Server: supports it. Client: will use it.
+  std::string probe;         // Server: shared memory the client must be able to open to use it.
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(hostName, sharedMemory, probe);
+  }
+};
+
+/// Splits rendering of one image between several servers: the image is
+/// cut into count horizontal bands of (almost) equal height and the server
+/// renders the band with the given index. Band boundaries are on even rows
+/// so that each band can be encoded as 4:2:0 video.
+struct TileAssignment {
+  std::uint32_t index = 0;
+  std::uint32_t count = 1;
+
+  /// First row of band i of an image with the given height.
+  std::uint32_t bandStart(std::uint32_t i, std::uint32_t height) const {
+    return i >= count ? height : std::uint32_t(std::uint64_t(height) * i / count) & ~1u;
+  }
+  std::uint32_t top(std::uint32_t height) const { return bandStart(index, height); }
+  std::uint32_t bottom(std::uint32_t height) const { return bandStart(index + 1, height); }
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(index, count);
+  }
+};
+
+/// Identifies an encoded video frame and echoes the control value that it
+/// was rendered with so that the client can tell how far the image it is
+/// displaying lags behind the user's input. The send time lets the client
+/// show frames at the rate they were sent (only differences between frames
+/// are meaningful because the server and client clocks are unrelated).
+struct FrameInfo {
+  std::string stream;
+  std::uint64_t frameId = 0;
+  float value = 0.f;
+  std::int64_t sendTimeUs = 0;  // Server's steady clock when the frame was sent (0 if unknown).
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(stream, frameId, value, sendTimeUs);
+  }
+};
+
+/// Request that the server pauses or resumes sending a video stream.
+struct StreamVisibility {
+  std::string stream;
+  bool visible = true;
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(stream, visible);
+  }
+};
+
+/// Statistics describing the progress of the server's sample accumulation.
+struct SampleStats {
+  std::uint64_t accumulated = 0;    // Samples per pixel accumulated so far.
+  std::uint64_t target = 0;         // Samples per pixel at which the render is considered converged.
+  float samplesPerSecond = 0.f;     // Measured throughput in samples per pixel per second.
+  float secondsToConverge = 0.f;    // Estimated time until target is reached (negative if unknown).
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(accumulated, target, samplesPerSecond, secondsToConverge);
+  }
+};
+
+/// Load progress of an asset on the server.
+struct AssetStatus {
+  std::string path;
+  float progress = 0.f;  // In the range [0, 1]: the asset is ready to use when this reaches 1.
+  std::string error;     // Why the load failed (empty unless it failed).
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(path, progress, error);
+  }
+};
+
+/// Request a thumbnail for each path (an empty path gets a placeholder tile).
+/// If the client already has an atlas with cachedHash it is not resent.
+struct ThumbnailRequest {
+  std::vector<std::string> paths;
+  std::string cachedHash;
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(paths, cachedHash);
+  }
+};
+
+/// All requested thumbnails packed in a grid in request order, so
+/// that the client only needs to upload a single texture.
+struct ThumbnailAtlas {
+  std::string hash;                // Hash of the encoded image (used as the client's cache key).
+  std::uint32_t tileWidth = 0;
+  std::uint32_t tileHeight = 0;
+  std::uint32_t columns = 0;
+  std::uint32_t count = 0;         // Number of tiles in the atlas.
+  std::vector<std::uint8_t> image; // Encoded image: empty if the client's cached copy is up to date.
+
+  template <class Archive>
+  void serialize(Archive& archive) {
+    archive(hash, tileWidth, tileHeight, columns, count, image);
+  }
 };
 
 } // end namespace packets
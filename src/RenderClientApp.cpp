@@ -4,30 +4,158 @@
 
 #include <GLFW/glfw3.h>
 #include <PacketSerialisation.h>
+#include <cereal/types/string.hpp>
 
-#include <iomanip>
+#include <boost/log/trivial.hpp>
 
-RenderClientApp::RenderClientApp(const nanogui::Vector2i& size, PacketMuxer& tx, PacketDemuxer& rx)
+#include <cstdio>
+#include <fstream>
+
+RenderClientApp::RenderClientApp(const nanogui::Vector2i& size, std::shared_ptr<PacketMuxer> tx,
+                                 std::shared_ptr<PacketDemuxer> rx, PacketDemuxer& videoRx,
+                                 const AssetCatalogue* nifCatalogue, const std::string& thumbnailCacheDir,
+                                 std::size_t decodeThreads, std::shared_ptr<TileServers> tileServers)
     : nanogui::Screen(size, "Image Preview", false),
-      sender(tx),
+      sender(*tx),
+      receiver(*rx),
+      tileSenders(tileServers ? tileServers->senders() : std::vector<PacketMuxer*>()),
+      catalogue(nifCatalogue),
+      thumbnailDir(thumbnailCacheDir),
+      startup(std::make_shared<StartupState>()),
+      decodePool(std::make_shared<DecodePool>(decodeThreads)),
       preview(nullptr),
-      form(nullptr) {
+      form(nullptr),
+      uiFrameTime(metrics::registry().histogram("ui_frame_ms")),
+      lastPreviewWidth(0) {
+
+  trace::setThreadName("ui");
 
-  syncWithServer(tx, rx, "ready");
+  // Pace redraws to the display refresh (redraws are only requested when
+  // something changes so an idle client does not draw at all):
+  glfwSwapInterval(1);
 
-  preview = new VideoPreviewWindow(this, "Render Preview", rx);
-  form = new ControlsForm(this, tx, rx, preview);
+  for (const auto& name : packets::videoStreams) {
+    auto* pool = decodePool.get();
+    videoClients[name] = std::make_unique<VideoClient>(videoRx, name, [pool]() { pool->notify(); });
+  }
+  streamSubscription = receiver.subscribe("video_stream", [this](const ComPacket::ConstSharedPacket& packet) {
+    std::string name;
+    deserialise(packet, name);
+    BOOST_LOG_TRIVIAL(debug) << "Server announced video stream: " << name;
+    {
+      std::lock_guard<std::mutex> lock(announcedMutex);
+      announcedStreams.push_back(name);
+    }
+    redraw();
+  });
 
-  // Have to manually set positions due to bug in ComboBox:
+  // The preview shows a placeholder until its stream has been negotiated
+  // (and stitches in the bands from any tile servers):
+  std::vector<std::unique_ptr<VideoClient>> tileClients;
+  if (tileServers) {
+    for (auto* tileRx : tileServers->receivers()) {
+      auto* pool = decodePool.get();
+      const auto metricsName = "render_preview_tile" + std::to_string(tileClients.size() + 1);
+      tileClients.push_back(std::make_unique<VideoClient>(*tileRx, "render_preview", [pool]() { pool->notify(); },
+                                                          metricsName));
+    }
+  }
+  preview = addVideoStream("render_preview", "Render Preview", std::move(tileClients));
   const int margin = 10;
-  nanogui::Vector2i pos(margin, margin);
-  preview->set_position(pos);
-  pos[0] += margin + preview->width();
-  form->set_position(nanogui::Vector2i(pos));
+  preview->set_position(nanogui::Vector2i(margin, margin));
   perform_layout();
+
+  // Sync with the server in the background so the UI can be shown immediately.
+  // The thread only touches this object and the connections through the
+  // shared state, which owns them, so that it can be left behind safely if
+  // the app is closed before the server responds:
+  startup->app = this;
+  startup->sender = tx;
+  startup->receiver = rx;
+  startup->tileServers = tileServers;
+  auto state = startup;
+  syncThread = std::thread([state]() {
+    syncWithServer(*state->sender, *state->receiver, "ready");
+    if (state->tileServers) {
+      state->tileServers->sync();
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->synced = true;
+    if (state->app != nullptr) {
+      state->app->redraw();
+    }
+  });
 }
 
 RenderClientApp::~RenderClientApp() {
+  bool synced = false;
+  {
+    std::lock_guard<std::mutex> lock(startup->mutex);
+    startup->app = nullptr;
+    synced = startup->synced;
+  }
+  if (synced) {
+    syncThread.join();
+  } else {
+    BOOST_LOG_TRIVIAL(warning) << "Closing before the server responded.";
+    syncThread.detach();
+  }
+}
+
+/// Create the controls once synchronised with the server (the controls
+/// send their initial state so the server must be ready to receive it).
+void RenderClientApp::createControls() {
+  form = new ControlsForm(this, sender, receiver, preview, catalogue, thumbnailDir, tileSenders);
+  perform_layout();
+}
+
+/// Have to manually set positions due to bug in ComboBox. The controls
+/// move if the preview changes size (e.g. when its stream starts).
+void RenderClientApp::layoutControls() {
+  if (preview->width() == lastPreviewWidth) {
+    return;
+  }
+  lastPreviewWidth = preview->width();
+  const int margin = 10;
+  form->set_position(nanogui::Vector2i(2 * margin + preview->width(), margin));
+}
+
+VideoPreviewWindow* RenderClientApp::addVideoStream(const std::string& name, const std::string& title,
+                                                    std::vector<std::unique_ptr<VideoClient>> tileClients) {
+  auto* window = new VideoPreviewWindow(this, title, std::move(videoClients.at(name)), decodePool, std::move(tileClients));
+  videoClients.erase(name);
+  streamWindows[name] = window;
+  return window;
+}
+
+/// Create windows for any streams the server has started since the last call.
+void RenderClientApp::addAnnouncedStreams() {
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(announcedMutex);
+    names.swap(announcedStreams);
+  }
+  for (const auto& name : names) {
+    if (streamWindows.count(name) == 0) {
+      if (videoClients.count(name) == 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Ignoring unknown video stream: " << name;
+        continue;
+      }
+      // Tile additional streams below the main preview:
+      const int margin = 10;
+      auto* window = addVideoStream(name, name);
+      const int column = int(streamWindows.size() - 2);
+      window->set_position(nanogui::Vector2i(margin + column * (preview->width() + margin),
+                                             2 * margin + preview->height()));
+    }
+    form->addVideoStream(name, [this, name](bool visible) {
+      streamWindows.at(name)->setStreamVisible(visible);
+      serialise(sender, "stream_visibility", packets::StreamVisibility{name, visible});
+      for (auto* tileSender : tileSenders) {
+        serialise(*tileSender, "stream_visibility", packets::StreamVisibility{name, visible});
+      }
+    });
+  }
 }
 
 bool RenderClientApp::keyboard_event(int key, int scancode, int action, int modifiers) {
@@ -40,6 +168,18 @@ bool RenderClientApp::keyboard_event(int key, int scancode, int action, int modi
       preview->reset();
       return true;
     }
+    if (key == GLFW_KEY_M) {
+      preview->toggleMetricsOverlay();
+      return true;
+    }
+    if (key == GLFW_KEY_X) {
+      exportMetrics();
+      return true;
+    }
+    if (key == GLFW_KEY_T) {
+      toggleTrace();
+      return true;
+    }
     if (key == GLFW_KEY_ESCAPE) {
       set_visible(false);
       return true;
@@ -49,18 +189,62 @@ bool RenderClientApp::keyboard_event(int key, int scancode, int action, int modi
   return false;
 }
 
+void RenderClientApp::exportMetrics() const {
+  std::ofstream csv("metrics.csv");
+  metrics::registry().writeCsv(csv);
+  std::ofstream json("metrics.json");
+  metrics::registry().writeJson(json);
+  BOOST_LOG_TRIVIAL(info) << "Exported metrics to metrics.csv and metrics.json";
+}
+
+/// The first press starts recording trace events and the second writes them to a file.
+void RenderClientApp::toggleTrace() const {
+  if (!trace::enabled()) {
+    trace::setEnabled(true);
+    BOOST_LOG_TRIVIAL(info) << "Trace recording started (press T again to save).";
+    return;
+  }
+  trace::setEnabled(false);
+  const auto count = trace::writeChromeJson("client_trace.json", "remote-ui");
+  if (count < 0) {
+    BOOST_LOG_TRIVIAL(error) << "Could not write client_trace.json";
+  } else {
+    BOOST_LOG_TRIVIAL(info) << "Wrote " << count << " trace events to client_trace.json";
+  }
+}
+
 void RenderClientApp::draw(NVGcontext* ctx) {
+  TRACE_SCOPE("RenderClientApp::draw");
+  metrics::ScopedTimer timer(uiFrameTime);
+  if (form == nullptr) {
+    std::lock_guard<std::mutex> lock(startup->mutex);
+    if (startup->synced) {
+      createControls();
+    }
+  }
   if (preview != nullptr && form != nullptr) {
-    // Update bandwidth text before display:
-    std::stringstream ss;
-    ss << std::fixed << std::setprecision(2)
-       << preview->getVideoBandwidthMbps();
-    form->bitRateText->set_value(ss.str());
-    // Update frame rate text:
-    ss.str(std::string());
-    ss << std::fixed << std::setprecision(2)
-       << preview->getFrameRate();
-    form->frameRateText->set_value(ss.str());
+    layoutControls();
+    addAnnouncedStreams();
+    form->updateNifList();
+    form->updateStatus();
+    if (form->nifListPending()) {
+      // Keep drawing until the background catalogue load has been displayed:
+      redraw();
+    }
+
+    // Update bandwidth and frame rate text before display (only
+    // when it changes to avoid unnecessary widget updates):
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.2f", preview->getVideoBandwidthMbps());
+    if (lastBitRateText != text) {
+      lastBitRateText = text;
+      form->bitRateText->set_value(lastBitRateText);
+    }
+    std::snprintf(text, sizeof(text), "%.2f", preview->getFrameRate());
+    if (lastFrameRateText != text) {
+      lastFrameRateText = text;
+      form->frameRateText->set_value(lastFrameRateText);
+    }
   }
   Screen::draw(ctx);
 }
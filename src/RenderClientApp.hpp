@@ -6,12 +6,25 @@
 #include <nanogui/nanogui.h>
 
 #include "ControlsForm.hpp"
+#include "Metrics.hpp"
+#include "TileServers.hpp"
 #include "VideoPreviewWindow.hpp"
 
-/// A screen containing all the application's other windows.
+/// A screen containing all the application's other windows. The screen
+/// is shown straight away: the handshake with the server and the video
+/// stream negotiation happen in the background.
 class RenderClientApp : public nanogui::Screen {
 public:
-  RenderClientApp(const nanogui::Vector2i& size, PacketMuxer& sender, PacketDemuxer& receiver);
+  /// The sender, receiver and tile servers are shared with the handshake
+  /// thread. The handshake can not be interrupted, so if the app is closed
+  /// before the server responds the thread is detached and keeps them alive
+  /// until it finishes.
+  /// @param videoReceiver Demuxer for video packets (the same as receiver unless video has its own connection).
+  /// @param tileServers Further servers that render bands of the preview (or nullptr).
+  RenderClientApp(const nanogui::Vector2i& size, std::shared_ptr<PacketMuxer> sender,
+                  std::shared_ptr<PacketDemuxer> receiver, PacketDemuxer& videoReceiver,
+                  const AssetCatalogue* nifCatalogue, const std::string& thumbnailCacheDir,
+                  std::size_t decodeThreads, std::shared_ptr<TileServers> tileServers = nullptr);
   virtual ~RenderClientApp();
 
   virtual bool keyboard_event(int key, int scancode, int action, int modifiers);
@@ -19,7 +32,44 @@ public:
   virtual void draw(NVGcontext* ctx);
 
 private:
+  void exportMetrics() const;
+  void toggleTrace() const;
+  VideoPreviewWindow* addVideoStream(const std::string& name, const std::string& title,
+                                     std::vector<std::unique_ptr<VideoClient>> tileClients = {});
+  void addAnnouncedStreams();
+  void createControls();
+  void layoutControls();
+
+  /// Everything the handshake thread uses.
+  struct StartupState {
+    std::mutex mutex;
+    bool synced = false;
+    RenderClientApp* app = nullptr; // Cleared when the app is destroyed.
+    std::shared_ptr<PacketMuxer> sender;
+    std::shared_ptr<PacketDemuxer> receiver;
+    std::shared_ptr<TileServers> tileServers;
+  };
+
   PacketMuxer& sender;
+  PacketDemuxer& receiver;
+  std::vector<PacketMuxer*> tileSenders;
+  const AssetCatalogue* catalogue;
+  std::string thumbnailDir;
+  std::shared_ptr<StartupState> startup;
+  std::thread syncThread;
+  std::shared_ptr<DecodePool> decodePool;
+  // Subscriptions for every possible stream are made before syncing with
+  // the server so that no packets are missed. Each client is moved into a
+  // window once the server announces that it is sending that stream:
+  std::map<std::string, std::unique_ptr<VideoClient>> videoClients;
+  std::map<std::string, VideoPreviewWindow*> streamWindows;
+  PacketSubscription streamSubscription;
+  std::mutex announcedMutex;
+  std::vector<std::string> announcedStreams;
   VideoPreviewWindow* preview;
   ControlsForm* form;
+  metrics::Histogram& uiFrameTime;
+  std::string lastBitRateText;
+  std::string lastFrameRateText;
+  int lastPreviewWidth;
 };
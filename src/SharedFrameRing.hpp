@@ -0,0 +1,178 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+/// Name of this machine (peers with the same name can share memory).
+inline std::string localHostName() {
+  char name[256] = {0};
+  gethostname(name, sizeof(name) - 1);
+  return name;
+}
+
+/// A ring of raw 8-bit frames in named shared memory so that a server and
+/// client on the same host can exchange video without encoding it. The
+/// writer never waits for the reader: each slot is protected by a sequence
+/// lock so a reader that falls a whole ring behind notices that the slot it
+/// was copying has been overwritten and can retry with the newest frame.
+///
+/// Frames are identified by their sequence number, which is even once the
+/// frame is complete (2 * frame number + 2) and odd while it is written.
+class SharedFrameRing {
+public:
+  static constexpr std::uint32_t magic = 0x474e4952; // "RING"
+
+  /// A frame's location in the ring (sent to the reader in place of encoded video).
+  struct Token {
+    std::uint32_t magic;
+    std::uint32_t slot;
+    std::uint64_t sequence;
+  };
+
+  /// Create (or replace) the named ring. It is removed again when the writer is destroyed.
+  static SharedFrameRing create(const std::string& name, int width, int height, int channels = 3,
+                                std::uint32_t slotCount = 4) {
+    namespace ipc = boost::interprocess;
+    ipc::shared_memory_object::remove(name.c_str());
+    ipc::shared_memory_object memory(ipc::create_only, name.c_str(), ipc::read_write);
+    const std::size_t step = std::size_t(width) * channels;
+    const std::size_t slotBytes = (slotHeaderBytes + step * height + 63) / 64 * 64;
+    memory.truncate(headerBytes() + slotBytes * slotCount);
+    SharedFrameRing ring(name, std::move(memory), ipc::read_write, true);
+    new (ring.region.get_address()) Header{magic, std::uint32_t(width), std::uint32_t(height),
+                                           std::uint32_t(channels), slotCount, step, slotBytes, {0}};
+    for (std::uint32_t s = 0; s < slotCount; ++s) {
+      new (ring.slot(s)) Slot{{0}, 0.0};
+    }
+    return ring;
+  }
+
+  /// Open a ring created by another process (read only).
+  static SharedFrameRing open(const std::string& name) {
+    namespace ipc = boost::interprocess;
+    ipc::shared_memory_object memory(ipc::open_only, name.c_str(), ipc::read_only);
+    SharedFrameRing ring(name, std::move(memory), ipc::read_only, false);
+    if (ring.header().magic != magic) {
+      throw std::runtime_error("Shared memory '" + name + "' is not a frame ring.");
+    }
+    return ring;
+  }
+
+  SharedFrameRing(SharedFrameRing&& other)
+      : name(std::move(other.name)), region(std::move(other.region)), owner(other.owner) {
+    other.owner = false;
+  }
+  SharedFrameRing& operator=(SharedFrameRing&&) = delete;
+
+  ~SharedFrameRing() {
+    if (owner && !name.empty()) {
+      boost::interprocess::shared_memory_object::remove(name.c_str());
+    }
+  }
+
+  int width() const { return header().width; }
+  int height() const { return header().height; }
+  int channels() const { return header().channels; }
+  std::size_t step() const { return header().step; }
+
+  /// Copy a frame (rows of width * channels bytes, source rows sourceStep
+  /// bytes apart) into the next slot. The tag is stored with the frame for
+  /// the reader (e.g. the control value the frame was rendered with).
+  /// @return The token that identifies the frame to readers.
+  Token write(const std::uint8_t* data, std::size_t sourceStep, double tag = 0.0) {
+    auto& h = header();
+    const std::uint64_t frame = h.published.load(std::memory_order_relaxed);
+    const std::uint32_t index = frame % h.slotCount;
+    Slot* s = slot(index);
+    s->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::uint8_t* pixels = slotPixels(index);
+    for (std::uint32_t y = 0; y < h.height; ++y) {
+      std::memcpy(pixels + y * h.step, data + y * sourceStep, h.step);
+    }
+    s->tag = tag;
+    s->sequence.store(2 * frame + 2, std::memory_order_release);
+    h.published.store(frame + 1, std::memory_order_release);
+    return Token{magic, index, 2 * frame + 2};
+  }
+
+  /// Token for the most recent complete frame (sequence 0 if there is none yet).
+  Token latest() const {
+    const auto& h = header();
+    const std::uint64_t frames = h.published.load(std::memory_order_acquire);
+    if (frames == 0) {
+      return Token{magic, 0, 0};
+    }
+    return Token{magic, std::uint32_t((frames - 1) % h.slotCount), 2 * frames};
+  }
+
+  /// Call read(pixels, step) on the frame's pixels (read must only copy them).
+  /// @return false if the frame was overwritten before or during the read
+  /// (in which case whatever read copied, and the tag, must be discarded).
+  template <class ReadFunction>
+  bool read(const Token& token, ReadFunction&& read, double* tag = nullptr) const {
+    if (token.magic != magic || token.slot >= header().slotCount || token.sequence == 0) {
+      return false;
+    }
+    const Slot* s = slot(token.slot);
+    if (s->sequence.load(std::memory_order_acquire) != token.sequence) {
+      return false;
+    }
+    read(static_cast<const std::uint8_t*>(slotPixels(token.slot)), header().step);
+    if (tag != nullptr) {
+      *tag = s->tag;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s->sequence.load(std::memory_order_relaxed) == token.sequence;
+  }
+
+private:
+  struct Header {
+    std::uint32_t magic;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t channels;
+    std::uint32_t slotCount;
+    std::uint64_t step;
+    std::uint64_t slotBytes;
+    std::atomic<std::uint64_t> published; // Number of frames written.
+  };
+
+  struct Slot {
+    std::atomic<std::uint64_t> sequence;
+    double tag;
+  };
+
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Shared memory atomics must be lock free.");
+
+  static std::size_t headerBytes() { return (sizeof(Header) + 63) / 64 * 64; }
+  static constexpr std::size_t slotHeaderBytes = 64; // Keeps the pixels cache line aligned.
+
+  SharedFrameRing(const std::string& memoryName, boost::interprocess::shared_memory_object&& memory,
+                  boost::interprocess::mode_t mode, bool isOwner)
+      : name(memoryName), region(memory, mode), owner(isOwner) {}
+
+  Header& header() { return *static_cast<Header*>(region.get_address()); }
+  const Header& header() const { return *static_cast<const Header*>(region.get_address()); }
+
+  std::uint8_t* base() const { return static_cast<std::uint8_t*>(region.get_address()) + headerBytes(); }
+  Slot* slot(std::uint32_t index) const { return reinterpret_cast<Slot*>(base() + index * header().slotBytes); }
+  std::uint8_t* slotPixels(std::uint32_t index) const {
+    return base() + index * header().slotBytes + slotHeaderBytes;
+  }
+
+  std::string name;
+  boost::interprocess::mapped_region region;
+  bool owner;
+};
@@ -0,0 +1,112 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "ThumbnailCache.hpp"
+
+#include <PacketSerialisation.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+
+ThumbnailCache::ThumbnailCache(PacketDemuxer& receiver, const std::string& cacheDirectory)
+    : directory(cacheDirectory),
+      atlasReady(false),
+      subscription(receiver.subscribe("thumbnail_atlas", [this](const ComPacket::ConstSharedPacket& packet) {
+        receive(packet);
+      })) {
+}
+
+void ThumbnailCache::request(PacketMuxer& sender, const std::vector<std::string>& thumbnailPaths) {
+  std::size_t key = 0;
+  for (const auto& p : thumbnailPaths) {
+    key = key * 31 + std::hash<std::string>()(p);
+  }
+  std::stringstream ss;
+  ss << std::hex << key;
+  requestKey = ss.str();
+
+  // If we have an atlas for this request on disk tell the server its hash:
+  packets::ThumbnailRequest request;
+  request.paths = thumbnailPaths;
+  std::ifstream index(indexFile());
+  index >> request.cachedHash;
+  if (!request.cachedHash.empty() &&
+      !std::filesystem::exists(directory + "/" + request.cachedHash + ".jpg")) {
+    request.cachedHash.clear();
+  }
+
+  BOOST_LOG_TRIVIAL(debug) << "Requesting " << thumbnailPaths.size() << " thumbnails (cached atlas: '"
+                           << request.cachedHash << "')";
+  serialise(sender, "thumbnail_request", request);
+}
+
+ThumbnailCache::Atlas ThumbnailCache::take() {
+  std::lock_guard<std::mutex> lock(atlasMutex);
+  atlasReady = false;
+  return std::move(atlas);
+}
+
+std::string ThumbnailCache::indexFile() const {
+  return directory + "/" + requestKey + ".index";
+}
+
+/// Called from the comms thread when the server replies.
+void ThumbnailCache::receive(const ComPacket::ConstSharedPacket& packet) {
+  packets::ThumbnailAtlas layout;
+  deserialise(packet, layout);
+  if (layout.count == 0) {
+    return;
+  }
+
+  const auto imageFile = directory + "/" + layout.hash + ".jpg";
+  std::vector<std::uint8_t> encoded;
+  if (layout.image.empty()) {
+    BOOST_LOG_TRIVIAL(debug) << "Loading thumbnail atlas from cache: " << imageFile;
+    std::ifstream file(imageFile, std::ios::binary);
+    encoded.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  } else {
+    encoded.swap(layout.image);
+    try {
+      std::filesystem::create_directories(directory);
+      std::ofstream(imageFile, std::ios::binary).write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+      std::ofstream(indexFile()) << layout.hash;
+      BOOST_LOG_TRIVIAL(debug) << "Cached thumbnail atlas as " << imageFile;
+    } catch (const std::filesystem::filesystem_error& e) {
+      BOOST_LOG_TRIVIAL(warning) << "Could not cache thumbnail atlas: " << e.what();
+    }
+  }
+
+  if (!decode(encoded, layout)) {
+    BOOST_LOG_TRIVIAL(warning) << "Failed to decode thumbnail atlas " << layout.hash;
+  } else if (onReady) {
+    onReady();
+  }
+}
+
+bool ThumbnailCache::decode(const std::vector<std::uint8_t>& encoded, const packets::ThumbnailAtlas& layout) {
+  if (encoded.empty()) {
+    return false;
+  }
+  cv::Mat bgr = cv::imdecode(encoded, cv::IMREAD_COLOR);
+  if (bgr.empty()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(atlasMutex);
+  atlas.width = bgr.cols;
+  atlas.height = bgr.rows;
+  atlas.layout = layout;
+  atlas.rgba.resize(atlas.width * atlas.height * 4);
+  cv::Mat rgba(atlas.height, atlas.width, CV_8UC4, atlas.rgba.data());
+  cv::cvtColor(bgr, rgba, cv::COLOR_BGR2RGBA);
+  atlasReady = true;
+  BOOST_LOG_TRIVIAL(info) << "Thumbnail atlas ready: " << layout.count << " tiles.";
+  return true;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <PacketComms.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "PacketDescriptions.hpp"
+
+/// Requests a thumbnail atlas from the server and keeps a copy on disk
+/// keyed by the atlas content hash so it is only transferred again when
+/// it changes. The decoded atlas is made available as an RGBA image.
+class ThumbnailCache {
+public:
+  struct Atlas {
+    std::vector<std::uint8_t> rgba;
+    int width = 0;
+    int height = 0;
+    packets::ThumbnailAtlas layout; // Tile layout (the encoded image is not retained).
+  };
+
+  ThumbnailCache(PacketDemuxer& receiver, const std::string& cacheDirectory);
+
+  /// Request thumbnails for the given paths (the atlas tiles will be in the same order).
+  void request(PacketMuxer& sender, const std::vector<std::string>& thumbnailPaths);
+
+  /// True once an atlas has been decoded and not yet taken.
+  bool available() const { return atlasReady; }
+
+  /// Move the decoded atlas out of the cache (returns an empty atlas if none is ready).
+  Atlas take();
+
+  /// Optional callback invoked (on the comms thread) when an atlas becomes available.
+  void setReadyCallback(std::function<void()> callback) { onReady = callback; }
+
+private:
+  void receive(const ComPacket::ConstSharedPacket& packet);
+  bool decode(const std::vector<std::uint8_t>& encoded, const packets::ThumbnailAtlas& layout);
+  std::string indexFile() const;
+
+  std::string directory;
+  std::string requestKey; // Identifies the list of thumbnails requested.
+  std::mutex atlasMutex;
+  Atlas atlas;
+  std::atomic<bool> atlasReady;
+  std::function<void()> onReady;
+  PacketSubscription subscription;
+};
@@ -0,0 +1,114 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "TileServers.hpp"
+#include "SharedFrameRing.hpp"
+
+#include <PacketSerialisation.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/// True if the server's probe segment can be opened, i.e. the client really
+/// shares memory with the server and not just its host name.
+bool canOpenProbe(const std::string& name) {
+  if (name.empty()) {
+    return false;
+  }
+  try {
+    SharedFrameRing::open(name);
+  } catch (const std::exception& e) {
+    BOOST_LOG_TRIVIAL(info) << "Can not open the server's shared memory: " << e.what();
+    return false;
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+TileServers::TileServers(const std::vector<std::string>& addresses, bool allowSharedMemory) {
+  const auto count = std::uint32_t(addresses.size() + 1);
+  for (std::uint32_t i = 0; i < addresses.size(); ++i) {
+    auto connection = std::make_unique<Connection>();
+    connection->address = addresses[i];
+    const auto colon = connection->address.rfind(':');
+    if (colon == std::string::npos) {
+      throw std::runtime_error("Tile server address must be host:port: " + connection->address);
+    }
+    const auto host = connection->address.substr(0, colon);
+    const int port = std::stoi(connection->address.substr(colon + 1));
+
+    connection->socket = std::make_unique<TcpSocket>();
+    if (!connection->socket->Connect(host.c_str(), port)) {
+      BOOST_LOG_TRIVIAL(info) << "Could not conect to tile server " << connection->address;
+      throw std::runtime_error("Unable to connect");
+    }
+    BOOST_LOG_TRIVIAL(info) << "Connected to tile server " << connection->address;
+    connection->sender = std::make_unique<PacketMuxer>(*connection->socket, packets::packetTypes);
+    connection->receiver = std::make_unique<PacketDemuxer>(*connection->socket, packets::packetTypes);
+
+    // Band 0 belongs to the main server:
+    const packets::TileAssignment tile{i + 1, count};
+    auto& tx = *connection->sender;
+    connection->hostInfoSubscription = connection->receiver->subscribe(
+        "server_info", [&tx, tile, allowSharedMemory](const ComPacket::ConstSharedPacket& packet) {
+          answerServerInfo(tx, packet, tile, allowSharedMemory);
+        });
+    connections.push_back(std::move(connection));
+  }
+}
+
+TileServers::~TileServers() {}
+
+std::vector<PacketMuxer*> TileServers::senders() const {
+  std::vector<PacketMuxer*> result;
+  for (const auto& connection : connections) {
+    result.push_back(connection->sender.get());
+  }
+  return result;
+}
+
+std::vector<PacketDemuxer*> TileServers::receivers() const {
+  std::vector<PacketDemuxer*> result;
+  for (const auto& connection : connections) {
+    result.push_back(connection->receiver.get());
+  }
+  return result;
+}
+
+void TileServers::sync() {
+  for (auto& connection : connections) {
+    syncWithServer(*connection->sender, *connection->receiver, "ready");
+    BOOST_LOG_TRIVIAL(debug) << "Synchronised with tile server " << connection->address;
+  }
+}
+
+void TileServers::answerServerInfo(PacketMuxer& sender, const ComPacket::ConstSharedPacket& packet,
+                                   const packets::TileAssignment& tile, bool allowSharedMemory) {
+  packets::HostInfo server;
+  deserialise(packet, server);
+  const auto hostName = localHostName();
+  const bool sameHost = server.hostName == hostName;
+  BOOST_LOG_TRIVIAL(info) << "Server host: " << server.hostName << (sameHost ? " (local)" : "");
+  const bool sharedMemory = allowSharedMemory && server.sharedMemory && sameHost && canOpenProbe(server.probe);
+  // Servers only read the assignment while waiting for client_info so it must be sent first:
+  if (tile.count > 1) {
+    serialise(sender, "tile_assignment", tile);
+  }
+  serialise(sender, "client_info", packets::HostInfo{hostName, sharedMemory, ""});
+}
+
+std::vector<std::string> TileServers::parseList(const std::string& list) {
+  std::vector<std::string> addresses;
+  std::stringstream ss(list);
+  std::string address;
+  while (std::getline(ss, address, ',')) {
+    if (!address.empty()) {
+      addresses.push_back(address);
+    }
+  }
+  return addresses;
+}
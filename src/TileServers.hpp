@@ -0,0 +1,56 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <PacketComms.h>
+#include <network/TcpSocket.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PacketDescriptions.hpp"
+
+/// Connections to the extra servers of a tiled render, where each server
+/// renders one horizontal band of the image (see packets::TileAssignment)
+/// so that large previews can be split across several machines. The main
+/// server renders band 0 and the servers here render bands 1 to N-1 in
+/// order. Controls are sent to every server and the render preview window
+/// stitches the bands back together.
+///
+/// Only the render preview is tiled: auxiliary streams, progress and the
+/// asset list come from the main server. Video is always received on the
+/// main connection of each tile server.
+class TileServers {
+public:
+  /// Connect to each server ("host:port"). Throws if one can not be reached.
+  TileServers(const std::vector<std::string>& addresses, bool allowSharedMemory);
+  virtual ~TileServers();
+
+  /// Number of bands the image is split into (including the main server's).
+  std::uint32_t tileCount() const { return std::uint32_t(connections.size() + 1); }
+
+  std::vector<PacketMuxer*> senders() const;
+  std::vector<PacketDemuxer*> receivers() const;
+
+  /// Complete the startup handshake with every server (blocks until they respond).
+  void sync();
+
+  /// Reply to a server's "server_info" with the band it should render and the client's host info.
+  static void answerServerInfo(PacketMuxer& sender, const ComPacket::ConstSharedPacket& packet,
+                               const packets::TileAssignment& tile, bool allowSharedMemory);
+
+  /// Split a comma separated list of "host:port" addresses.
+  static std::vector<std::string> parseList(const std::string& list);
+
+private:
+  struct Connection {
+    std::string address;
+    std::unique_ptr<TcpSocket> socket;
+    std::unique_ptr<PacketMuxer> sender;
+    std::unique_ptr<PacketDemuxer> receiver;
+    PacketSubscription hostInfoSubscription;
+  };
+
+  std::vector<std::unique_ptr<Connection>> connections;
+};
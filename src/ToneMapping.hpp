@@ -0,0 +1,83 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Log encoding of linear HDR images into 8 bits and the display transform
+/// that turns them back into viewable images. The server log-encodes its
+/// renders so the client can change exposure and tone mapping locally: with
+/// 8-bit input the whole display transform is a 256 entry lookup table.
+///
+/// Code values map linearly to stops (log2 of the linear value) between
+/// minStop and maxStop. Code 0 is treated as black.
+namespace tonemap {
+
+enum class Curve { Clamp, Reinhard, Aces };
+
+inline Curve parseCurve(const std::string& name) {
+  if (name == "clamp") { return Curve::Clamp; }
+  if (name == "reinhard") { return Curve::Reinhard; }
+  if (name == "aces") { return Curve::Aces; }
+  throw std::runtime_error("Unknown tone curve: '" + name + "'");
+}
+
+struct DisplaySettings {
+  float exposure = 0.f; // In stops.
+  float gamma = 2.2f;
+  Curve curve = Curve::Aces;
+};
+
+/// Log encode a linear float image (any number of channels) into an 8-bit
+/// image of the same size. out can be an existing (e.g. pooled) image.
+/// @param scratch Float image reused between calls to avoid allocations.
+inline void encodeLog(const cv::Mat& linear, cv::Mat& out, cv::Mat& scratch, float minStop, float maxStop) {
+  // code = 255 * (log2(x) - minStop) / (maxStop - minStop), rounded and saturated by convertTo():
+  const double range = maxStop - minStop;
+  cv::max(linear, std::exp2(minStop), scratch);
+  cv::log(scratch, scratch);
+  scratch.convertTo(out, CV_8U, 255.0 / (range * M_LN2), -255.0 * minStop / range);
+}
+
+inline float applyCurve(float x, Curve curve) {
+  switch (curve) {
+  case Curve::Clamp:
+    return std::min(x, 1.f);
+  case Curve::Reinhard:
+    return x / (1.f + x);
+  case Curve::Aces:
+    // Narkowicz's fit to the ACES filmic curve:
+    return std::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.f, 1.f);
+  }
+  return x;
+}
+
+/// Lookup table (for cv::LUT) from log codes to display values. Alpha (the
+/// fourth channel if there is one) is passed through unchanged.
+inline cv::Mat makeDisplayLut(const DisplaySettings& settings, float minStop, float maxStop, int channels) {
+  cv::Mat colour(1, 256, CV_8U);
+  const float scale = std::exp2(settings.exposure);
+  for (int code = 0; code < 256; ++code) {
+    const float linear = code == 0 ? 0.f : std::exp2(minStop + code * (maxStop - minStop) / 255.f) * scale;
+    const float display = std::pow(applyCurve(linear, settings.curve), 1.f / settings.gamma);
+    colour.at<std::uint8_t>(code) = cv::saturate_cast<std::uint8_t>(255.f * display);
+  }
+  std::vector<cv::Mat> planes(channels, colour);
+  if (channels == 4) {
+    planes[3] = cv::Mat(1, 256, CV_8U);
+    for (int code = 0; code < 256; ++code) {
+      planes[3].at<std::uint8_t>(code) = code;
+    }
+  }
+  cv::Mat lut;
+  cv::merge(planes, lut);
+  return lut;
+}
+
+} // end namespace tonemap
@@ -0,0 +1,153 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Scoped trace events that can be exported in the Chrome trace event
+/// format (open the file in chrome://tracing or https://ui.perfetto.dev).
+///
+/// Each thread writes events into its own ring buffer so recording takes
+/// no locks. When tracing is disabled a TRACE_SCOPE costs one relaxed
+/// atomic load. Event names must be string literals (only the pointer
+/// is stored).
+namespace trace {
+
+namespace detail {
+
+struct Event {
+  const char* name;
+  std::int64_t beginNs;
+  std::int64_t durationNs;
+};
+
+/// Events recorded by one thread. Only the owning thread writes to the
+/// ring and it publishes each event by incrementing 'recorded'. The oldest
+/// events are overwritten once the ring is full.
+struct ThreadBuffer {
+  static constexpr std::size_t capacity = 1 << 16;
+
+  ThreadBuffer(int threadId) : id(threadId), name("thread " + std::to_string(threadId)), recorded(0) {}
+
+  void record(const char* eventName, std::int64_t beginNs, std::int64_t durationNs) {
+    if (events.empty()) {
+      events.resize(capacity);
+    }
+    const auto n = recorded.load(std::memory_order_relaxed);
+    events[n % capacity] = Event{eventName, beginNs, durationNs};
+    recorded.store(n + 1, std::memory_order_release);
+  }
+
+  const int id;
+  std::string name;
+  std::vector<Event> events;
+  std::atomic<std::uint64_t> recorded;
+};
+
+struct Tracer {
+  std::atomic<bool> enabled{false};
+  std::mutex mutex; // Protects the list of buffers and their names.
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+inline Tracer& tracer() {
+  static Tracer instance;
+  return instance;
+}
+
+/// Buffers are shared with the tracer so events survive their thread.
+inline ThreadBuffer& localBuffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    auto& t = tracer();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    buffer = std::make_shared<ThreadBuffer>(int(t.buffers.size()) + 1);
+    t.buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+inline std::int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // end namespace detail
+
+inline void setEnabled(bool enable) { detail::tracer().enabled.store(enable, std::memory_order_relaxed); }
+inline bool enabled() { return detail::tracer().enabled.load(std::memory_order_relaxed); }
+
+/// Name the calling thread in exported traces.
+inline void setThreadName(const std::string& name) {
+  auto& buffer = detail::localBuffer();
+  std::lock_guard<std::mutex> lock(detail::tracer().mutex);
+  buffer.name = name;
+}
+
+/// Records the lifetime of the object as a trace event (if tracing is
+/// enabled when the object is constructed).
+class Scope {
+public:
+  Scope(const char* eventName) : name(enabled() ? eventName : nullptr), begin(name ? detail::nowNs() : 0) {}
+  ~Scope() {
+    if (name) {
+      detail::localBuffer().record(name, begin, detail::nowNs() - begin);
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+private:
+  const char* name;
+  std::int64_t begin;
+};
+
+/// Write the events recorded by every thread to a Chrome trace JSON file.
+/// Safe to call while other threads are still recording, although events
+/// recorded during the export may be missing.
+/// @return The number of events written or -1 if the file could not be opened.
+inline long writeChromeJson(const std::string& fileName, const std::string& processName) {
+  std::ofstream out(fileName);
+  if (!out) {
+    return -1;
+  }
+
+  auto& t = detail::tracer();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  long count = 0;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"" << processName << "\"}}";
+  for (const auto& buffer : t.buffers) {
+    out << ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+        << ", \"name\": \"thread_name\", \"args\": {\"name\": \"" << buffer->name << "\"}}";
+    const auto recorded = buffer->recorded.load(std::memory_order_acquire);
+    const auto available = std::min<std::uint64_t>(recorded, detail::ThreadBuffer::capacity);
+    for (auto i = recorded - available; i < recorded; ++i) {
+      const auto& e = buffer->events[i % detail::ThreadBuffer::capacity];
+      out << ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id << ", \"name\": \"" << e.name
+          << "\", \"ts\": " << e.beginNs / 1000.0 << ", \"dur\": " << e.durationNs / 1000.0 << "}";
+      count += 1;
+    }
+  }
+  out << "\n]}\n";
+  return count;
+}
+
+} // end namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+/// Trace the enclosing scope. Name must be a string literal.
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
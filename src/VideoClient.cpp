@@ -7,13 +7,54 @@
 
 #include <boost/log/trivial.hpp>
 
-VideoClient::VideoClient(PacketDemuxer& demuxer, const std::string& avPacketName)
-    : m_packetOffset(0),
+VideoClient::VideoClient(PacketDemuxer& demuxer, const std::string& avPacketName, std::function<void()> onPacket,
+                         const std::string& metricsName)
+    : m_streamName(avPacketName),
+      m_packetOffset(0),
+      m_lastTotalVideoBytes(0),
+      m_totalVideoBytes(0),
+      m_queuedPackets(0),
+      m_packetWaitMs(0.0),
+      m_bytesReceived(metrics::registry().counter((metricsName.empty() ? avPacketName : metricsName) + "_video_bytes_received")),
+      m_queueDepth(metrics::registry().gauge((metricsName.empty() ? avPacketName : metricsName) + "_video_packet_queue_depth")),
+      m_packetWait(metrics::registry().histogram((metricsName.empty() ? avPacketName : metricsName) + "_packet_wait_ms")),
+      m_onPacket(onPacket),
+      m_hasFrameInfo(false),
+      m_missedFrameInfo(false),
       m_avDataSubscription(
           demuxer.subscribe(avPacketName, [this](const ComPacket::ConstSharedPacket& packet) {
+            TRACE_SCOPE("VideoClient::receivePacket");
             m_avDataPackets.emplace(packet);
+            m_queueDepth.set(++m_queuedPackets);
+            m_bytesReceived.add(packet->getDataSize());
             m_totalVideoBytes += packet->getDataSize();
             BOOST_LOG_TRIVIAL(trace) << "Received compressed video packet of size " << packet->getDataSize() << std::endl;
+            if (m_onPacket) {
+              m_onPacket();
+            }
+          })),
+      m_streamInfoSubscription(
+          demuxer.subscribe("stream_info", [this](const ComPacket::ConstSharedPacket& packet) {
+            packets::StreamInfo info;
+            deserialise(packet, info);
+            if (info.stream == m_streamName) {
+              BOOST_LOG_TRIVIAL(debug) << "Video stream '" << info.stream << "' uses codec '" << info.codec << "' at "
+                                       << info.width << "x" << info.height;
+              std::lock_guard<std::mutex> lock(m_infoMutex);
+              m_streamInfo = info;
+            }
+          })),
+      m_frameInfoSubscription(
+          demuxer.subscribe("frame_info", [this](const ComPacket::ConstSharedPacket& packet) {
+            packets::FrameInfo info;
+            deserialise(packet, info);
+            if (info.stream == m_streamName) {
+              {
+                std::lock_guard<std::mutex> lock(m_infoMutex);
+                m_frameInfos.push_back(info);
+              }
+              m_frameInfoArrived.notify_all();
+            }
           })),
       m_avTimeout(0) {
 }
@@ -21,6 +62,15 @@ VideoClient::VideoClient(PacketDemuxer& demuxer, const std::string& avPacketName
 VideoClient::~VideoClient() {
 }
 
+bool VideoClient::waitForStream() {
+  using namespace std::chrono_literals;
+  SimpleQueue::LockedQueue lockedQueue = m_avDataPackets.lock();
+  if (m_avDataPackets.empty() && connected()) {
+    lockedQueue.waitNotEmpty(1s);
+  }
+  return !m_avDataPackets.empty();
+}
+
 /**
     @param videoTimeout If no video data is received for longer than this duration then streaming will terminate.
 */
@@ -30,23 +80,32 @@ bool VideoClient::initialiseVideoStream(const std::chrono::seconds& videoTimeout
 
   m_lastBandwidthCalcTime = std::chrono::steady_clock::now();
 
-  // Create a video reader object that uses function/callback IO:
-  m_videoIO.reset(new FFMpegStdFunctionIO(FFMpegCustomIO::ReadBuffer,
-                                          std::bind(&VideoClient::readPacket, std::ref(*this), std::placeholders::_1, std::placeholders::_2)));
-  m_streamer.reset(new LibAvCapture(*m_videoIO));
-  if (m_streamer->IsOpen() == false) {
-    BOOST_LOG_TRIVIAL(debug) << "Failed to open video stream.";
-    return false;
+  // The stream info is sent before the first video packet so once a packet
+  // has arrived we know which decoder to use:
+  {
+    using namespace std::chrono_literals;
+    SimpleQueue::LockedQueue lockedQueue = m_avDataPackets.lock();
+    while (m_avDataPackets.empty() && m_avDataSubscription.getDemuxer().ok() && !avHasTimedOut()) {
+      lockedQueue.waitNotEmpty(1s);
+    }
   }
 
-  // Get some frames so we can extract correct image dimensions:
-  bool gotFrame = false;
-  for (int i = 0; i < 2; ++i) {
-    gotFrame = m_streamer->GetFrame();
-    m_streamer->DoneFrame();
+  // Create a decoder that reads via the packet queue:
+  packets::StreamInfo info;
+  {
+    std::lock_guard<std::mutex> lock(m_infoMutex);
+    info = m_streamInfo;
+  }
+  try {
+    m_decoder = createVideoDecoder(info.codec,
+                                   std::bind(&VideoClient::readPacket, std::ref(*this), std::placeholders::_1, std::placeholders::_2),
+                                   info.width, info.height, info.sharedMemory);
+  } catch (const std::exception& e) {
+    BOOST_LOG_TRIVIAL(error) << e.what();
+    return false;
   }
 
-  if (gotFrame == false) {
+  if (m_decoder->open() == false) {
     BOOST_LOG_TRIVIAL(debug) << "Failed to acquire frames from video stream.";
     return false;
   }
@@ -58,20 +117,62 @@ bool VideoClient::initialiseVideoStream(const std::chrono::seconds& videoTimeout
   return true;
 }
 
-bool VideoClient::receiveVideoFrame(std::function<void(LibAvCapture&)> callback) {
-  if (m_streamer == nullptr) {
-    throw std::logic_error(std::string(__FUNCTION__) + ": streamer object not allocated.");
+bool VideoClient::receiveVideoFrame(std::function<void(VideoDecoder&)> callback) {
+  if (m_decoder == nullptr) {
+    throw std::logic_error(std::string(__FUNCTION__) + ": decoder object not allocated.");
   }
 
-  bool gotFrame = m_streamer->GetFrame();
+  m_packetWaitMs = 0.0;
+  bool gotFrame = m_decoder->getFrame();
   if (gotFrame) {
-    callback(*m_streamer);
-    m_streamer->DoneFrame();
+    takeFrameInfo();
+    callback(*m_decoder);
+    m_decoder->doneFrame();
   }
 
   return gotFrame;
 }
 
+/// The server sends a frame's info once the frame has been encoded so it
+/// can arrive just after the frame's video data. Infos are matched to
+/// frames in order, except that if the decoder knows the frame's ID the
+/// infos of any frames it skipped are dropped.
+void VideoClient::takeFrameInfo() {
+  using namespace std::chrono_literals;
+  std::uint64_t id = 0;
+  const bool idKnown = m_decoder->frameId(id);
+  std::unique_lock<std::mutex> lock(m_infoMutex);
+  auto arrived = [&]() {
+    while (idKnown && !m_frameInfos.empty() && m_frameInfos.front().frameId < id) {
+      m_frameInfos.pop_front();
+    }
+    return !m_frameInfos.empty();
+  };
+  // Only wait if the server sends infos (i.e. for the first frame or once one has arrived):
+  const auto timeout = m_hasFrameInfo || !m_missedFrameInfo ? 50ms : 0ms;
+  if (!m_frameInfoArrived.wait_for(lock, timeout, arrived)) {
+    BOOST_LOG_TRIVIAL(debug) << "No frame info for video frame of stream " << m_streamName;
+    m_missedFrameInfo = true;
+    return;
+  }
+  if (idKnown && m_frameInfos.front().frameId != id) {
+    return; // This frame's info is missing (keep it for the next frame).
+  }
+  m_currentFrameInfo = m_frameInfos.front();
+  m_frameInfos.pop_front();
+  m_hasFrameInfo = true;
+}
+
+std::string VideoClient::codec() const {
+  std::lock_guard<std::mutex> lock(m_infoMutex);
+  return m_streamInfo.codec;
+}
+
+packets::StreamInfo VideoClient::streamInfo() const {
+  std::lock_guard<std::mutex> lock(m_infoMutex);
+  return m_streamInfo;
+}
+
 /**
     @param seconds Time elapsed since last call to this function (assumes video has benn constantly streaming for this whole time).
     @return Bandwidth used by video stream in bits per second.
@@ -86,26 +187,29 @@ double VideoClient::computeVideoBandwidthConsumed() {
 }
 
 bool VideoClient::streamerOk() const {
-  return m_streamer != nullptr && m_streamer->IoError() == false;
+  return m_decoder != nullptr && m_decoder->ioError() == false;
 }
 
 bool VideoClient::streamerIoError() const {
-  if (m_streamer.get() == nullptr) {
-    BOOST_LOG_TRIVIAL(error) << "Stream capture object not allocated." << std::endl;
-    return false;  // Streamer not allocated yet (obviosuly this does not count as IO error)
+  if (m_decoder.get() == nullptr) {
+    BOOST_LOG_TRIVIAL(error) << "Stream decoder object not allocated." << std::endl;
+    return false;  // Decoder not allocated yet (obviosuly this does not count as IO error)
   }
 
-  return m_streamer->IoError();
+  return m_decoder->ioError();
 }
 
 /**
-    This is called back by the LibAvCapture object when it wants to decode
-    the next AV packet (i.e. in consequence of calling m_streamer->GetFrame()).
+    This is called back by the decoder when it wants to decode the next AV
+    packet (i.e. in consequence of calling m_decoder->getFrame()).
 */
 int VideoClient::readPacket(uint8_t* buffer, int size) {
+  TRACE_SCOPE("VideoClient::readPacket");
   using namespace std::chrono_literals;
   const auto retries = 4u;
   SimpleQueue::LockedQueue lockedQueue = m_avDataPackets.lock();
+  const auto waitStart = std::chrono::steady_clock::now();
+  const bool waited = m_avDataPackets.empty();
   while (m_avDataPackets.empty() && m_avDataSubscription.getDemuxer().ok()) {
     lockedQueue.waitNotEmpty(1s);
 
@@ -127,6 +231,11 @@ int VideoClient::readPacket(uint8_t* buffer, int size) {
   }
 
   resetAvTimeout();
+  if (waited) {
+    const double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+    m_packetWait.record(waitMs);
+    m_packetWaitMs += waitMs;
+  }
 
   // We were asked for more than packet contains so loop through packets until
   // we have returned what we needed or there are no more packets:
@@ -141,6 +250,7 @@ int VideoClient::readPacket(uint8_t* buffer, int size) {
       std::copy(packet->getData().begin() + m_packetOffset, packet->getData().end(), buffer);
       m_packetOffset = 0;  // Reset the packet offset so the next packet will be read from beginning.
       m_avDataPackets.pop();
+      m_queueDepth.set(--m_queuedPackets);
       buffer += availableSize;
       required -= availableSize;
     } else {
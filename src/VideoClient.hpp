@@ -4,12 +4,21 @@
 #ifndef __VIDEO_CLIENT_H__
 #define __VIDEO_CLIENT_H__
 
-#include <VideoLib.h>
-
 #include <PacketComms.h>
 
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+
+#include "Metrics.hpp"
+#include "PacketDescriptions.hpp"
+#include "Trace.hpp"
+#include "VideoDecoder.hpp"
 
 // Copyright (c) 2022 Graphcore Ltd. All rights reserved.
 
@@ -22,36 +31,89 @@ class PacketDemuxer;
 
     In the constructor a subscription is made to AvData packets which are
     simply enqued as they are received. Note that the server must be sending
-    packets with the same name.
+    packets with the same name. The decoder backend is chosen from the
+    stream's "stream_info" packet (streams without one are decoded with libav)
+    which also gives the frame size so the decoder does not need to probe it.
+
+    Each successfully encoded frame is followed by a "frame_info" packet.
+    These are queued and matched to decoded frames in order (one per frame,
+    or by frame ID if the decoder knows it) so the control value that a
+    frame was rendered with is known while it is displayed.
 */
 class VideoClient {
 public:
-  VideoClient(PacketDemuxer& demuxer, const std::string& avPacketName);
+  /// @param onPacket Optional callback invoked (on the comms thread) after each packet is queued.
+  /// @param metricsName Prefix of the client's metrics (defaults to the stream name).
+  VideoClient(PacketDemuxer& demuxer, const std::string& avPacketName, std::function<void()> onPacket = nullptr,
+              const std::string& metricsName = std::string());
   virtual ~VideoClient();
 
+  /// Wait (for up to about a second) for the server to start the stream.
+  /// @return true once the first video packet has arrived.
+  bool waitForStream();
+
+  /// False if the connection the video arrives on has closed.
+  bool connected() const { return m_avDataSubscription.getDemuxer().ok(); }
+
   bool initialiseVideoStream(const std::chrono::seconds& videoTimeout);
-  int getFrameWidth() const { return m_streamer->GetFrameWidth(); };
-  int getFrameHeight() const { return m_streamer->GetFrameHeight(); };
+  int getFrameWidth() const { return m_decoder->frameWidth(); };
+  int getFrameHeight() const { return m_decoder->frameHeight(); };
+
+  bool receiveVideoFrame(std::function<void(VideoDecoder&)>);
 
-  bool receiveVideoFrame(std::function<void(LibAvCapture&)>);
+  /// Info for the frame most recently passed to the receiveVideoFrame()
+  /// callback. Only valid if hasFrameInfo() (servers that do not send
+  /// frame info leave it unset).
+  bool hasFrameInfo() const { return m_hasFrameInfo; }
+  const packets::FrameInfo& currentFrameInfo() const { return m_currentFrameInfo; }
+
+  /// Name of the decoder backend in use (valid after initialiseVideoStream()).
+  std::string codec() const;
+
+  /// How the stream is encoded (valid after initialiseVideoStream()).
+  packets::StreamInfo streamInfo() const;
+
+  const std::string& streamName() const { return m_streamName; }
 
   double computeVideoBandwidthConsumed();
 
+  /// Time spent waiting for packets to arrive during the last call to receiveVideoFrame().
+  double lastPacketWaitMs() const { return m_packetWaitMs; }
+
+  /// Number of received packets that have not been fully consumed by the decoder.
+  std::size_t queuedPackets() const { return m_queuedPackets; }
+
 protected:
   bool streamerOk() const;
   bool streamerIoError() const;
   int readPacket(uint8_t* buffer, int size);
+  void takeFrameInfo();
 
 private:
+  std::string m_streamName;
   SimpleQueue m_avInfoPackets;
   SimpleQueue m_avDataPackets;
   int m_packetOffset;
   uint64_t m_lastTotalVideoBytes;
   uint64_t m_totalVideoBytes;
+  std::atomic<std::size_t> m_queuedPackets;
+  double m_packetWaitMs;
+  metrics::Counter& m_bytesReceived;
+  metrics::Gauge& m_queueDepth;
+  metrics::Histogram& m_packetWait;
+  std::function<void()> m_onPacket;
+  mutable std::mutex m_infoMutex;
+  packets::StreamInfo m_streamInfo;
+  std::deque<packets::FrameInfo> m_frameInfos; // Protected by m_infoMutex.
+  std::condition_variable m_frameInfoArrived;
+  packets::FrameInfo m_currentFrameInfo;
+  bool m_hasFrameInfo;
+  bool m_missedFrameInfo; // A frame has been decoded without an info.
   PacketSubscription m_avDataSubscription;
+  PacketSubscription m_streamInfoSubscription;
+  PacketSubscription m_frameInfoSubscription;
 
-  std::unique_ptr<FFMpegStdFunctionIO> m_videoIO;
-  std::unique_ptr<LibAvCapture> m_streamer;
+  std::unique_ptr<VideoDecoder> m_decoder;
 
   void resetAvTimeout();
   bool avHasTimedOut();
@@ -0,0 +1,288 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "VideoDecoder.hpp"
+#include "LosslessCodec.hpp"
+#include "SharedFrameRing.hpp"
+#include "Trace.hpp"
+
+#include <VideoLib.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/// Convert packed BGR rows into RGB or RGBA (opaque) rows.
+void bgrToRgb(const std::uint8_t* input, std::size_t inputStep, int width, int height,
+              std::uint8_t* buffer, int stride, int channels) {
+  for (int y = 0; y < height; ++y) {
+    const std::uint8_t* in = input + std::size_t(y) * inputStep;
+    std::uint8_t* out = buffer + std::size_t(y) * stride;
+    for (int x = 0; x < width; ++x) {
+      out[channels * x + 0] = in[3 * x + 2];
+      out[channels * x + 1] = in[3 * x + 1];
+      out[channels * x + 2] = in[3 * x + 0];
+      if (channels == 4) {
+        out[channels * x + 3] = 255;
+      }
+    }
+  }
+}
+
+class LibAvDecoder : public VideoDecoder {
+public:
+  LibAvDecoder(ReadFunction read, int frameWidth, int frameHeight)
+      : io(FFMpegCustomIO::ReadBuffer, read), width(frameWidth), height(frameHeight) {}
+
+  bool open() override {
+    capture.reset(new LibAvCapture(io));
+    if (capture->IsOpen() == false) {
+      BOOST_LOG_TRIVIAL(debug) << "Failed to open video stream.";
+      return false;
+    }
+    if (width > 0 && height > 0) {
+      return true;
+    }
+
+    // Get some frames so we can extract correct image dimensions:
+    bool gotFrame = false;
+    for (int i = 0; i < 2; ++i) {
+      gotFrame = capture->GetFrame();
+      capture->DoneFrame();
+    }
+    return gotFrame;
+  }
+
+  int frameWidth() const override { return width > 0 ? width : capture->GetFrameWidth(); }
+  int frameHeight() const override { return height > 0 ? height : capture->GetFrameHeight(); }
+  bool getFrame() override { return capture->GetFrame(); }
+  bool extractRgb(std::uint8_t* buffer, int stride) override {
+    capture->ExtractRgbImage(buffer, stride);
+    return true;
+  }
+  bool extractRgba(std::uint8_t* buffer, int stride) override {
+    capture->ExtractRgbaImage(buffer, stride);
+    return true;
+  }
+  void doneFrame() override { capture->DoneFrame(); }
+  bool ioError() const override { return capture != nullptr && capture->IoError(); }
+
+private:
+  FFMpegStdFunctionIO io;
+  std::unique_ptr<LibAvCapture> capture;
+  const int width;  // Zero if the size must be probed.
+  const int height;
+};
+
+class LosslessDecoder : public VideoDecoder {
+public:
+  LosslessDecoder(ReadFunction readFunction, int frameWidth, int frameHeight)
+      : read(readFunction), error(false), width(frameWidth), height(frameHeight) {}
+
+  bool open() override {
+    // The frame size is in every header so if it is not known decode the first frame:
+    return (width > 0 && height > 0) || getFrame();
+  }
+
+  int frameWidth() const override { return width; }
+  int frameHeight() const override { return height; }
+
+  bool getFrame() override {
+    TRACE_SCOPE("LosslessDecoder::getFrame");
+    lossless::Header header;
+    if (!readAll(reinterpret_cast<std::uint8_t*>(&header), sizeof(header))) {
+      return false;
+    }
+    if (header.magic != lossless::magic) {
+      BOOST_LOG_TRIVIAL(error) << "Corrupt lossless video frame header.";
+      error = true;
+      return false;
+    }
+
+    // The caller's buffers have the negotiated size so the frame size can
+    // only come from the header while probing for it:
+    const bool sizeKnown = width > 0 && height > 0;
+    const bool sizeMatches = header.width == std::uint32_t(width) && header.height == std::uint32_t(height);
+    const bool sizeValid = header.width > 0 && header.height > 0 &&
+                           header.width <= lossless::maxDimension && header.height <= lossless::maxDimension;
+    const std::size_t size = std::size_t(header.width) * header.height * 3;
+    if ((sizeKnown && !sizeMatches) || !sizeValid || header.payloadSize > lossless::maxPayloadSize(size)) {
+      BOOST_LOG_TRIVIAL(error) << "Lossless video frame header does not match the stream (" << header.width << "x"
+                               << header.height << ", " << header.payloadSize << " bytes).";
+      error = true;
+      return false;
+    }
+
+    tokens.resize(header.payloadSize);
+    if (!readAll(tokens.data(), tokens.size())) {
+      return false;
+    }
+
+    if (header.keyFrame || frame.size() != size) {
+      width = header.width;
+      height = header.height;
+      frame.assign(size, 0);
+    }
+    if (!lossless::decodeDelta(tokens.data(), tokens.size(), frame.data(), frame.size())) {
+      BOOST_LOG_TRIVIAL(error) << "Corrupt lossless video frame.";
+      error = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool extractRgb(std::uint8_t* buffer, int stride) override {
+    extract(buffer, stride, 3);
+    return true;
+  }
+  bool extractRgba(std::uint8_t* buffer, int stride) override {
+    extract(buffer, stride, 4);
+    return true;
+  }
+  void doneFrame() override {}
+  bool ioError() const override { return error; }
+
+private:
+  bool readAll(std::uint8_t* buffer, std::size_t size) {
+    while (size > 0) {
+      const int count = read(buffer, int(size));
+      if (count <= 0) {
+        error = true;
+        return false;
+      }
+      buffer += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  /// The frame is stored as BGR:
+  void extract(std::uint8_t* buffer, int stride, int channels) {
+    bgrToRgb(frame.data(), std::size_t(width) * 3, width, height, buffer, stride, channels);
+  }
+
+  ReadFunction read;
+  bool error;
+  int width;
+  int height;
+  std::vector<std::uint8_t> tokens;
+  std::vector<std::uint8_t> frame;
+};
+
+/// Reads raw frames from a SharedFrameRing written by a server on the same
+/// host. The stream only carries tokens that say which slot holds each frame
+/// so extraction copies straight from shared memory into the caller's buffer.
+class SharedMemoryDecoder : public VideoDecoder {
+public:
+  SharedMemoryDecoder(ReadFunction readFunction, const std::string& ringName)
+      : read(readFunction), name(ringName), error(false), token{0, 0, 0}, id(0), idKnown(false) {}
+
+  bool open() override {
+    try {
+      ring = std::make_unique<SharedFrameRing>(SharedFrameRing::open(name));
+    } catch (const std::exception& e) {
+      BOOST_LOG_TRIVIAL(error) << "Could not open shared memory video '" << name << "': " << e.what();
+      error = true;
+      return false;
+    }
+    return true;
+  }
+
+  int frameWidth() const override { return ring ? ring->width() : 0; }
+  int frameHeight() const override { return ring ? ring->height() : 0; }
+
+  bool getFrame() override {
+    TRACE_SCOPE("SharedMemoryDecoder::getFrame");
+    // Tokens of frames that were skipped by jumping ahead (below) are ignored:
+    const std::uint64_t shown = token.sequence;
+    do {
+      if (!readToken()) {
+        return false;
+      }
+    } while (token.sequence <= shown);
+
+    // If the server has lapped us the slot was reused so show its newest
+    // frame instead. The frame ID is read now (it is the slot's tag) so the
+    // frame is matched to the right info:
+    auto skipPixels = [](const std::uint8_t*, std::size_t) {};
+    double tag = 0.0;
+    idKnown = ring->read(token, skipPixels, &tag);
+    if (!idKnown) {
+      token = ring->latest();
+      idKnown = ring->read(token, skipPixels, &tag);
+    }
+    id = std::uint64_t(tag);
+    return true;
+  }
+
+  bool extractRgb(std::uint8_t* buffer, int stride) override { return extract(buffer, stride, 3); }
+  bool extractRgba(std::uint8_t* buffer, int stride) override { return extract(buffer, stride, 4); }
+  void doneFrame() override {}
+
+  bool frameId(std::uint64_t& frameId) const override {
+    frameId = id;
+    return idKnown;
+  }
+
+  bool ioError() const override { return error; }
+
+private:
+  bool readToken() {
+    auto* bytes = reinterpret_cast<std::uint8_t*>(&token);
+    std::size_t remaining = sizeof(token);
+    while (remaining > 0) {
+      const int count = read(bytes, int(remaining));
+      if (count <= 0) {
+        error = true;
+        return false;
+      }
+      bytes += count;
+      remaining -= count;
+    }
+    if (token.magic != SharedFrameRing::magic) {
+      BOOST_LOG_TRIVIAL(error) << "Corrupt shared memory frame token.";
+      error = true;
+      return false;
+    }
+    return true;
+  }
+
+  /// Frames are not retried with a newer one because the frame's info has
+  /// already been matched to it.
+  bool extract(std::uint8_t* buffer, int stride, int channels) {
+    auto copy = [&](const std::uint8_t* pixels, std::size_t step) {
+      bgrToRgb(pixels, step, ring->width(), ring->height(), buffer, stride, channels);
+    };
+    if (!idKnown || !ring->read(token, copy)) {
+      BOOST_LOG_TRIVIAL(warning) << "Dropped shared memory frame that was overwritten while it was read.";
+      return false;
+    }
+    return true;
+  }
+
+  ReadFunction read;
+  std::string name;
+  bool error;
+  std::unique_ptr<SharedFrameRing> ring;
+  SharedFrameRing::Token token;
+  std::uint64_t id;  // Frame ID of the current token (if idKnown).
+  bool idKnown;
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<VideoDecoder> createVideoDecoder(const std::string& codec, VideoDecoder::ReadFunction read,
+                                                 int width, int height, const std::string& sharedMemory) {
+  if (codec == "libav") {
+    return std::make_unique<LibAvDecoder>(read, width, height);
+  }
+  if (codec == "lossless") {
+    return std::make_unique<LosslessDecoder>(read, width, height);
+  }
+  if (codec == "shm") {
+    return std::make_unique<SharedMemoryDecoder>(read, sharedMemory);
+  }
+  throw std::runtime_error("Unknown video codec: '" + codec + "'");
+}
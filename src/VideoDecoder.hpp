@@ -0,0 +1,55 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/// Interface to a video decoder backend. Compressed data is pulled from the
+/// transport through a read function so backends do not depend on the comms
+/// system. The server announces which backend a stream uses in its
+/// "stream_info" packet (see createVideoDecoder() for the names).
+class VideoDecoder {
+public:
+  /// Same contract as FFmpeg custom IO: fill up to size bytes and return the
+  /// number read or a negative value on error.
+  using ReadFunction = std::function<int(std::uint8_t* buffer, int size)>;
+
+  virtual ~VideoDecoder() {}
+
+  /// Read the start of the stream. After this succeeds the frame size is known
+  /// (if the size was given to createVideoDecoder() no frames are consumed).
+  virtual bool open() = 0;
+  virtual int frameWidth() const = 0;
+  virtual int frameHeight() const = 0;
+
+  /// Decode the next frame (blocks until enough data has arrived).
+  virtual bool getFrame() = 0;
+
+  /// Convert the current frame into packed 8-bit RGB or RGBA.
+  /// Only valid between getFrame() and doneFrame().
+  /// @return false if the frame could not be read intact (the buffer may then
+  /// hold part of it so the frame must be dropped).
+  virtual bool extractRgb(std::uint8_t* buffer, int stride) = 0;
+  virtual bool extractRgba(std::uint8_t* buffer, int stride) = 0;
+  virtual void doneFrame() = 0;
+
+  /// The server's ID of the current frame if the backend carries it with the
+  /// video (backends that never skip frames do not need to).
+  virtual bool frameId(std::uint64_t& id) const { return false; }
+
+  virtual bool ioError() const = 0;
+};
+
+/// Create a decoder backend by name:
+///  - "libav": lossy MPEG-4 decoded by FFmpeg (the default).
+///  - "lossless": delta/run-length coded BGR (see LosslessCodec.hpp), the
+///    cheapest option on the CPU when bandwidth is plentiful.
+///  - "shm": raw frames in the named SharedFrameRing (server on the same host).
+/// If the frame size is known in advance (from the stream's "stream_info")
+/// the decoder does not need to probe the stream for it.
+/// Throws std::runtime_error if the name is not recognised.
+std::unique_ptr<VideoDecoder> createVideoDecoder(const std::string& codec, VideoDecoder::ReadFunction read,
+                                                 int width = 0, int height = 0, const std::string& sharedMemory = "");
@@ -6,172 +6,608 @@
 
 #include <boost/log/trivial.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Stop predicting if the server has not caught up with the input after this
+// long (e.g. because it clamps the value):
+const std::chrono::milliseconds predictionTimeout(1000);
+
+// Duration of the cross-fade from a reprojected frame to the real one:
+const std::chrono::milliseconds blendDuration(100);
+
+// Longest time a tile is held back waiting for the other tiles to catch up:
+const std::chrono::milliseconds tileSyncTimeout(500);
+
+// Frames the jitter buffer can hold (including the one on display):
+const std::size_t maxPacedFrames = 16;
+
+std::int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const float pi = M_PI;
+
+/// Metrics are per stream so that windows do not mix their measurements.
+std::string streamMetric(const VideoClient& client, const std::string& name) {
+  return client.streamName() + "_" + name;
+}
+
+/// Wrap an angle difference to [-pi, pi).
+float wrapAngle(float radians) {
+  radians = std::fmod(radians + pi, 2.f * pi);
+  return (radians < 0.f ? radians + 2.f * pi : radians) - pi;
+}
+
+/// Rotate every row of a tightly packed image left by shift pixels.
+void shiftColumns(const std::uint8_t* in, std::uint8_t* out, int width, int height, int channels, int shift) {
+  shift = ((shift % width) + width) % width;
+  const std::size_t rowBytes = std::size_t(width) * channels;
+  const std::size_t headBytes = std::size_t(shift) * channels;
+  cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; ++y) {
+      const std::uint8_t* src = in + y * rowBytes;
+      std::uint8_t* dst = out + y * rowBytes;
+      std::memcpy(dst, src + headBytes, rowBytes - headBytes);
+      std::memcpy(dst + rowBytes - headBytes, src, headBytes);
+    }
+  });
+}
+
+} // end anonymous namespace
+
 VideoPreviewWindow::VideoPreviewWindow(
     nanogui::Screen* screen,
     const std::string& title,
-    PacketDemuxer& receiver)
+    std::unique_ptr<VideoClient> client,
+    std::shared_ptr<DecodePool> pool,
+    std::vector<std::unique_ptr<VideoClient>> otherTiles)
     : nanogui::Window(screen, title),
-      videoClient(std::make_unique<VideoClient>(receiver, "render_preview")),
+      parentScreen(screen),
+      videoClient(std::move(client)),
+      tileClients(std::move(otherTiles)),
+      tileSyncMisses(metrics::registry().counter(streamMetric(*videoClient, "tile_sync_misses_total"))),
+      frameWidth(0),
+      frameHeight(0),
       texture(nullptr),
-      mbps(0.0),
+      imageView(nullptr),
+      mbps(metrics::registry().smoothed(streamMetric(*videoClient, "video_mbps"))),
       m_lastFrameTime(std::chrono::steady_clock::now()),
-      fps(0.f),
+      fps(metrics::registry().smoothed(streamMetric(*videoClient, "frame_rate"))),
+      decodeTime(metrics::registry().histogram(streamMetric(*videoClient, "decode_ms"))),
+      convertTime(metrics::registry().histogram(streamMetric(*videoClient, "colour_convert_ms"))),
+      frameInterval(metrics::registry().histogram(streamMetric(*videoClient, "frame_interval_ms"))),
+      uploadTime(metrics::registry().histogram(streamMetric(*videoClient, "texture_upload_ms"))),
+      presentInterval(metrics::registry().histogram(streamMetric(*videoClient, "present_interval_ms"))),
+      lastPresentTime(std::chrono::steady_clock::now()),
+      overlay(metrics::registry(),
+              {streamMetric(*videoClient, "packet_wait_ms"), streamMetric(*videoClient, "decode_ms"),
+               streamMetric(*videoClient, "colour_convert_ms"), streamMetric(*videoClient, "texture_upload_ms"),
+               streamMetric(*videoClient, "frame_interval_ms"), streamMetric(*videoClient, "present_interval_ms"),
+               "ui_frame_ms"},
+              {streamMetric(*videoClient, "video_packet_queue_depth"), streamMetric(*videoClient, "jitter_buffer_ms")},
+              streamMetric(*videoClient, "")),
+      showMetrics(false),
+      decodePool(pool),
       newFrameDecoded(false),
-      runDecoderThread(true) {
+      decodeEnabled(true),
+      streamReady(false),
+      stopNegotiation(false),
+      negotiationDone(false),
+      startTime(std::chrono::steady_clock::now()),
+      timeToFirstFrame(metrics::registry().gauge(streamMetric(*videoClient, "time_to_first_frame_ms"))),
+      firstFrameShown(false),
+      framePacing(false),
+      jitterBuffer(maxPacedFrames, streamMetric(*videoClient, "")),
+      shownFrame(nullptr),
+      reprojection(false),
+      predicting(false),
+      predictedValue(0.f),
+      frameValueKnown(false),
+      frameValue(0.f),
+      decodedValueKnown(false),
+      decodedValue(0.f),
+      shownShift(0),
+      blending(false),
+      reprojectedFrames(metrics::registry().counter(streamMetric(*videoClient, "reprojected_frames_total"))),
+      displayChanged(false),
+      toneMapTime(metrics::registry().histogram(streamMetric(*videoClient, "tone_map_ms"))) {
   using namespace nanogui;
-  using namespace std::chrono_literals;
-  bool videoOk = videoClient->initialiseVideoStream(5s);
-
-  if (videoOk) {
-    // Allocate a buffer to store the decoded and converted images:
-    auto w = videoClient->getFrameWidth();
-    auto h = videoClient->getFrameHeight();
-
-    // Create the texture first because internally nanogui will create
-    // one with the preferred format and we need to know how to allcoate
-    // the buffers:
-    texture = new Texture(
-        Texture::PixelFormat::RGB,
-        Texture::ComponentFormat::UInt8,
-        Vector2i(w, h),
-        Texture::InterpolationMode::Trilinear,
-        Texture::InterpolationMode::Nearest);
-    const auto ch = texture->channels();
-    BOOST_LOG_TRIVIAL(trace) << "Created texture with "
-                             << texture->channels() << " channels, "
-                             << "data ptr: " << (void*)bgrBuffer.data();
-    if (!(ch == 3 || ch == 4)) {
-      throw std::logic_error("Texture returned has an unsupported number of texture channels.");
+
+  tiles.push_back(std::make_unique<Tile>(*this, *videoClient));
+  for (auto& tileClient : tileClients) {
+    tiles.push_back(std::make_unique<Tile>(*this, *tileClient));
+  }
+
+  // Show a placeholder until the stream has been negotiated:
+  this->set_layout(new GroupLayout(10));
+  statusLabel = new Label(this, "Waiting for video...");
+  this->set_size(Vector2i(320, 80));
+  negotiationThread = std::thread(&VideoPreviewWindow::negotiateStream, this);
+}
+
+VideoPreviewWindow::~VideoPreviewWindow() {
+  stopNegotiation = true;
+  negotiationThread.join();
+  if (texture != nullptr) {
+    for (auto& tile : tiles) {
+      decodePool->remove(tile.get());
     }
+  }
+}
 
-    bgrBuffer.resize(w * h * ch);
-    this->set_size(Vector2i(w, h));
-    this->set_layout(new GroupLayout(0));
-    imageView = new ImageView(this);
-
-    for (auto c = 0; c < bgrBuffer.size(); c += ch) {
-      bgrBuffer[c + 0] = 255;
-      bgrBuffer[c + 1] = 0;
-      bgrBuffer[c + 2] = 0;
-      if (ch == 4) {
-        bgrBuffer[c + 3] = 128;
+/// Runs on a background thread so that a slow server does not block the UI.
+void VideoPreviewWindow::negotiateStream() {
+  using namespace std::chrono_literals;
+  trace::setThreadName("negotiate_" + videoClient->streamName());
+  while (!stopNegotiation && videoClient->connected()) {
+    if (videoClient->waitForStream()) {
+      TRACE_SCOPE("VideoPreviewWindow::negotiateStream");
+      const bool ready = videoClient->initialiseVideoStream(5s);
+      if (ready) {
+        initialiseTiles();
+      } else {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to initialise video stream.";
       }
+      streamReady = ready;
+      break;
     }
+  }
+  // The texture is created on the UI thread:
+  negotiationDone = true;
+  parentScreen->redraw();
+}
 
-    texture->upload(bgrBuffer.data());
-
-    imageView->set_size(Vector2i(w, h));
-    imageView->set_image(texture);
-    imageView->center();
-    imageView->set_pixel_callback(
-        [this](const Vector2i& pos, char** out, size_t size) {
-          // The information provided by this callback is used to
-          // display pixel values at high magnification:
-          auto w = videoClient->getFrameWidth();
-
-          std::size_t index = (pos.x() + w * pos.y()) * texture->channels();
-          for (int c = 0; c < texture->channels(); ++c) {
-            uint8_t value = bgrBuffer[index + c];
-            snprintf(out[c], size, "%i", (int)value);
-          }
-        });
+/// Negotiate the other tiles' streams and find where their bands go in the
+/// image. Tiles that do not fit are dropped (their bands are left blank).
+void VideoPreviewWindow::initialiseTiles() {
+  using namespace std::chrono_literals;
+  const auto info = videoClient->streamInfo();
+  const int width = videoClient->getFrameWidth();
+  const int height = info.fullHeight > 0 ? int(info.fullHeight) : videoClient->getFrameHeight();
+  tiles.front()->top = info.tileTop;
+  for (auto tile = tiles.begin() + 1; tile != tiles.end();) {
+    auto& client = (*tile)->client;
+    while (!stopNegotiation && client.connected() && !client.waitForStream()) {}
+    bool ok = !stopNegotiation && client.initialiseVideoStream(5s);
+    const auto tileInfo = client.streamInfo();
+    ok = ok && client.getFrameWidth() == width && int(tileInfo.fullHeight) == height &&
+         int(tileInfo.tileTop) + client.getFrameHeight() <= height;
+    if (!ok) {
+      BOOST_LOG_TRIVIAL(warning) << "Tile " << (tile - tiles.begin()) << " of " << title()
+                                 << " can not be stitched into the image.";
+      // Dropping the client also stops it queueing packets:
+      auto owner = std::find_if(tileClients.begin(), tileClients.end(),
+                                [&](const std::unique_ptr<VideoClient>& c) { return c.get() == &client; });
+      tile = tiles.erase(tile);
+      tileClients.erase(owner);
+      continue;
+    }
+    (*tile)->top = tileInfo.tileTop;
+    ++tile;
+  }
+  if (tiles.size() > 1) {
+    BOOST_LOG_TRIVIAL(info) << "Stitching " << title() << " from " << tiles.size() << " tiles.";
+  }
+}
+
+/// Called from draw() once the stream is ready.
+void VideoPreviewWindow::createTexture() {
+  using namespace nanogui;
 
-    BOOST_LOG_TRIVIAL(info) << "Succesfully initialised video stream.";
-    startDecodeThread();
+  // Allocate a buffer to store the decoded and converted images (the
+  // stream may be the first band of a larger tiled image):
+  streamInfo = videoClient->streamInfo();
+  frameWidth = videoClient->getFrameWidth();
+  frameHeight = streamInfo.fullHeight > 0 ? int(streamInfo.fullHeight) : videoClient->getFrameHeight();
+  auto w = frameWidth;
+  auto h = frameHeight;
 
-  } else {
-    BOOST_LOG_TRIVIAL(warning) << "Failed to initialise video stream.";
+  // Create the texture first because internally nanogui will create
+  // one with the preferred format and we need to know how to allcoate
+  // the buffers:
+  auto* newTexture = new Texture(
+      Texture::PixelFormat::RGB,
+      Texture::ComponentFormat::UInt8,
+      Vector2i(w, h),
+      Texture::InterpolationMode::Trilinear,
+      Texture::InterpolationMode::Nearest);
+  const auto ch = newTexture->channels();
+  BOOST_LOG_TRIVIAL(trace) << "Created texture with "
+                           << newTexture->channels() << " channels, "
+                           << "data ptr: " << (void*)bgrBuffer.data();
+  if (!(ch == 3 || ch == 4)) {
+    throw std::logic_error("Texture returned has an unsupported number of texture channels.");
   }
-}
 
-VideoPreviewWindow::~VideoPreviewWindow() {
-  stopDecodeThread();
+  bgrBuffer.resize(w * h * ch);
+  warpBuffer.resize(bgrBuffer.size());
+  blendBuffer.resize(bgrBuffer.size());
+  jitterBuffer.resize(bgrBuffer.size());
+  if (streamInfo.transfer == "log") {
+    displayBuffer.resize(bgrBuffer.size());
+    displayLut = tonemap::makeDisplayLut(displaySettings, streamInfo.logMinStop, streamInfo.logMaxStop, ch);
+  }
+  remove_child(statusLabel);
+  statusLabel = nullptr;
+  this->set_size(Vector2i(w, h));
+  this->set_layout(new GroupLayout(0));
+  imageView = new ImageView(this);
+
+  for (auto c = 0; c < bgrBuffer.size(); c += ch) {
+    bgrBuffer[c + 0] = 255;
+    bgrBuffer[c + 1] = 0;
+    bgrBuffer[c + 2] = 0;
+    if (ch == 4) {
+      bgrBuffer[c + 3] = 128;
+    }
+  }
+
+  newTexture->upload(bgrBuffer.data());
+
+  imageView->set_size(Vector2i(w, h));
+  imageView->set_image(newTexture);
+  imageView->center();
+  imageView->set_pixel_callback(
+      [this](const Vector2i& pos, char** out, size_t size) {
+        // The information provided by this callback is used to
+        // display pixel values at high magnification:
+        auto w = frameWidth;
+
+        std::size_t index = (pos.x() + w * pos.y()) * texture->channels();
+        for (int c = 0; c < texture->channels(); ++c) {
+          uint8_t value = shownPixels()[index + c];
+          snprintf(out[c], size, "%i", (int)value);
+        }
+      });
+  parentScreen->perform_layout();
+
+  // Decoding can start now there is somewhere to put the frames:
+  texture = newTexture;
+  BOOST_LOG_TRIVIAL(info) << "Succesfully initialised video stream: " << title();
+  for (auto& tile : tiles) {
+    decodePool->add(tile.get());
+  }
 }
 
-// Return the bgrBuffer as an opencv image:
+// Return the displayed frame as an opencv image:
 cv::Mat VideoPreviewWindow::getImage() const {
-  const auto w = videoClient->getFrameWidth();
-  const auto h = videoClient->getFrameHeight();
+  if (texture == nullptr) {
+    return cv::Mat();
+  }
+  const auto w = frameWidth;
+  const auto h = frameHeight;
   BOOST_LOG_TRIVIAL(info) << "Retrieving image " << w << "x" << h;
-  cv::Mat image(h, w, CV_8UC4, (void*)bgrBuffer.data());
+  cv::Mat image(h, w, CV_8UC(texture->channels()), (void*)shownPixels());
+  if (!displayLut.empty()) {
+    // Save what is displayed rather than the log-encoded values:
+    cv::Mat display;
+    cv::LUT(image, displayLut, display);
+    return display;
+  }
   return image;
 }
 
-void VideoPreviewWindow::startDecodeThread() {
-  // Thread just decodes video frames as fast as it can:
-  videoDecodeThread.reset(new std::thread([&]() {
-    BOOST_LOG_TRIVIAL(debug) << "Video decode thread launched.";
-    if (videoClient == nullptr) {
-      BOOST_LOG_TRIVIAL(debug) << "Video client must be initialised before decoding.";
-      throw std::logic_error("No VideoClient object available.");
-    }
+void VideoPreviewWindow::setReprojection(bool enable) {
+  reprojection = enable;
+  predicting = false;
+  parentScreen->redraw();
+}
 
-    while (runDecoderThread) {
-      decodeVideoFrame();
+void VideoPreviewWindow::predictValue(float radians) {
+  if (!reprojection) {
+    return;
+  }
+  predictedValue = radians;
+  predictionTime = std::chrono::steady_clock::now();
+  predicting = true;
+  parentScreen->redraw();
+}
+
+void VideoPreviewWindow::setDisplaySettings(const tonemap::DisplaySettings& settings) {
+  displaySettings = settings;
+  if (texture != nullptr && streamInfo.transfer == "log") {
+    displayLut = tonemap::makeDisplayLut(displaySettings, streamInfo.logMinStop, streamInfo.logMaxStop, texture->channels());
+    displayChanged = true;
+    parentScreen->redraw();
+  }
+}
+
+void VideoPreviewWindow::setFramePacing(bool enable) {
+  std::lock_guard<std::mutex> lock(bufferMutex);
+  framePacing = enable;
+  if (!enable) {
+    // Go straight back to the latest decoded frame:
+    jitterBuffer.reset();
+    shownFrame = nullptr;
+    frameValueKnown = decodedValueKnown;
+    frameValue = decodedValue;
+    newFrameDecoded = true;
+  }
+  parentScreen->redraw();
+}
+
+void VideoPreviewWindow::setStreamVisible(bool visible) {
+  decodeEnabled = visible;
+  set_visible(visible);
+  decodePool->notify();
+}
+
+bool VideoPreviewWindow::tileReadyToDecode(const Tile& tile) const {
+  if (!decodeEnabled || texture == nullptr || tile.client.queuedPackets() == 0) {
+    return false;
+  }
+  if (framePacing && !jitterBuffer.hasFreeSlot()) {
+    return false; // Wait for the UI to show some of the queued frames.
+  }
+  if (tiles.size() == 1) {
+    return true;
+  }
+  // Hold the tile while it is ahead of another tile or the last complete
+  // image has not been uploaded yet (so its band is not overwritten):
+  bool held = newFrameDecoded;
+  for (const auto& other : tiles) {
+    if (other.get() != &tile && tile.hasFrame && (!other->hasFrame || other->frameId < tile.frameId)) {
+      held = true;
     }
-  }));
-}
-
-void VideoPreviewWindow::stopDecodeThread() {
-  runDecoderThread = false;
-  if (videoDecodeThread) {
-    try {
-      videoDecodeThread->join();
-      BOOST_LOG_TRIVIAL(debug) << "Video decode thread joined successfully.";
-      videoDecodeThread.reset();
-    } catch (std::system_error& e) {
-      BOOST_LOG_TRIVIAL(warning) << "Video decode thread could not be joined.";
+  }
+  if (!held) {
+    tile.heldSinceMs = 0;
+    return true;
+  }
+  const auto now = nowMs();
+  std::int64_t notHeld = 0;
+  tile.heldSinceMs.compare_exchange_strong(notHeld, now);
+  return now - tile.heldSinceMs > tileSyncTimeout.count();
+}
+
+// A held tile becomes ready when its sync timeout expires (nothing notifies the pool then).
+// Once the timeout has passed the tile is waiting on something that does notify:
+std::chrono::steady_clock::time_point VideoPreviewWindow::tileRecheckTime(const Tile& tile) const {
+  using Clock = std::chrono::steady_clock;
+  const std::int64_t heldSince = tile.heldSinceMs;
+  const auto expiry = Clock::time_point(std::chrono::milliseconds(heldSince + 1)) + tileSyncTimeout;
+  if (heldSince == 0 || expiry <= Clock::now()) {
+    return Clock::time_point::max();
+  }
+  return expiry;
+}
+
+bool VideoPreviewWindow::tilesInSync() const {
+  for (const auto& tile : tiles) {
+    if (!tile->hasFrame || tile->frameId != tiles.front()->frameId) {
+      return false;
     }
   }
+  return true;
 }
 
-/// Decode a video frame into the buffer.
-void VideoPreviewWindow::decodeVideoFrame() {
-  newFrameDecoded = videoClient->receiveVideoFrame(
-      [this](LibAvCapture& stream) {
+/// Decode a video frame into the tile's rows of the buffer.
+void VideoPreviewWindow::decodeVideoFrame(Tile& tile) {
+  TRACE_SCOPE("VideoPreviewWindow::decodeVideoFrame");
+  using Clock = std::chrono::steady_clock;
+  using Ms = std::chrono::duration<double, std::milli>;
+  const auto startTime = Clock::now();
+  double convertMs = 0.0;
+  bool extracted = true;
+  const bool gotFrame = tile.client.receiveVideoFrame(
+      [&](VideoDecoder& stream) {
         BOOST_LOG_TRIVIAL(debug) << "Decoded video frame";
-        auto w = stream.GetFrameWidth();
-        auto h = stream.GetFrameHeight();
+        auto w = stream.frameWidth();
         if (texture != nullptr) {
-          // Extract decoded data to the buffer:
+          // Extract decoded data to the tile's rows of the buffer:
+          TRACE_SCOPE("colourConvert");
           std::lock_guard<std::mutex> lock(bufferMutex);
+          if (&tile == tiles.front().get()) {
+            decodedValueKnown = videoClient->hasFrameInfo();
+            decodedValue = videoClient->currentFrameInfo().value;
+          }
+          const auto convertStart = Clock::now();
+          std::uint8_t* rows = bgrBuffer.data() + std::size_t(tile.top) * w * texture->channels();
           if (texture->channels() == 3) {
-            stream.ExtractRgbImage(bgrBuffer.data(), w * texture->channels());
+            extracted = stream.extractRgb(rows, w * texture->channels());
           } else if (texture->channels() == 4) {
-            stream.ExtractRgbaImage(bgrBuffer.data(), w * texture->channels());
+            extracted = stream.extractRgba(rows, w * texture->channels());
           } else {
             throw std::runtime_error("Unsupported number of texture channels");
           }
+          convertMs = Ms(Clock::now() - convertStart).count();
         }
       });
 
-  if (newFrameDecoded) {
-    double bps = videoClient->computeVideoBandwidthConsumed();
+  if (gotFrame && extracted) {
+    // Time spent blocked on the network is not decode time:
+    const auto newFrameTime = Clock::now();
+    decodeTime.record(Ms(newFrameTime - startTime).count() - tile.client.lastPacketWaitMs() - convertMs);
+    convertTime.record(convertMs);
+
+    // The image is only shown once every tile has caught up (or a held tile timed out):
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    tile.frameId = tile.client.hasFrameInfo() ? tile.client.currentFrameInfo().frameId : tile.frameId + 1;
+    tile.hasFrame = true;
+    const bool released = tile.heldSinceMs.exchange(0) != 0;
+    if (!tilesInSync()) {
+      if (!released) {
+        return;
+      }
+      tileSyncMisses.add();
+    }
+
+    if (framePacing) {
+      // Queue a copy of the frame to be shown when it is due (see presentPacedFrame()):
+      if (auto* frame = jitterBuffer.acquire()) {
+        std::memcpy(frame->pixels.data(), bgrBuffer.data(), bgrBuffer.size());
+        frame->valueKnown = decodedValueKnown;
+        frame->value = decodedValue;
+        const auto& client = tiles.front()->client;
+        jitterBuffer.push(frame, client.hasFrameInfo() ? client.currentFrameInfo().sendTimeUs : 0, newFrameTime);
+      }
+    } else {
+      frameValueKnown = decodedValueKnown;
+      frameValue = decodedValue;
+      newFrameDecoded = true;
+    }
+
+    // Ask the UI thread to draw the new frame:
+    parentScreen->redraw();
+
+    double bps = 0.0;
+    for (auto& t : tiles) {
+      bps += t->client.computeVideoBandwidthConsumed();
+    }
     if (std::isfinite(bps)) {
       auto imbps = bps / (1024.0 * 1024.0);
-      mbps = (0.9f * mbps) + (.1f * imbps);
+      mbps.update(imbps);
       BOOST_LOG_TRIVIAL(trace) << "Video bit-rate instantaneous: " << imbps << " Mbps" << std::endl;
-      BOOST_LOG_TRIVIAL(debug) << "Video bit-rate filtered: " << mbps << " Mbps" << std::endl;
+      BOOST_LOG_TRIVIAL(debug) << "Video bit-rate filtered: " << mbps.get() << " Mbps" << std::endl;
     }
 
     // Calculate instantaneous frame rate:
-    auto newFrameTime = std::chrono::steady_clock::now();
-    auto ifps = 1000.0 / std::chrono::duration_cast<std::chrono::milliseconds>(newFrameTime - m_lastFrameTime).count();
-    if (std::isfinite(ifps)) {
-      fps = (0.9f * fps) + (.1f * ifps);
-    }
+    const double intervalMs = Ms(newFrameTime - m_lastFrameTime).count();
+    frameInterval.record(intervalMs);
+    auto ifps = 1000.0 / intervalMs;
+    fps.update(ifps);
     BOOST_LOG_TRIVIAL(trace) << "Frame rate instantaneous: " << ifps << " Fps" << std::endl;
-    BOOST_LOG_TRIVIAL(debug) << "Frame rate filtered: " << fps << " Fps" << std::endl;
+    BOOST_LOG_TRIVIAL(debug) << "Frame rate filtered: " << fps.get() << " Fps" << std::endl;
     m_lastFrameTime = newFrameTime;
   }
 }
 
+void VideoPreviewWindow::uploadFrame(bool newFrame) {
+  TRACE_SCOPE("textureUpload");
+  using Clock = std::chrono::steady_clock;
+  metrics::ScopedTimer timer(uploadTime);
+  std::lock_guard<std::mutex> lock(bufferMutex);
+  const auto now = Clock::now();
+  const int w = frameWidth;
+  const int h = frameHeight;
+  const int ch = texture->channels();
+
+  // Horizontal shift that turns the displayed frame into the predicted view:
+  if (predicting && now - predictionTime > predictionTimeout) {
+    predicting = false;
+  }
+  int shift = 0;
+  if (predicting && frameValueKnown) {
+    shift = std::lround(wrapAngle(predictedValue - frameValue) / (2.f * pi) * w);
+  }
+  if (shift == 0) {
+    predicting = false; // Caught up (or nothing to predict from).
+  }
+
+  if (shift != 0) {
+    TRACE_SCOPE("reproject");
+    shiftColumns(shownPixels(), warpBuffer.data(), w, h, ch, shift);
+    uploadTexture(warpBuffer.data());
+    shownShift = shift;
+    blending = false;
+    reprojectedFrames.add();
+    return;
+  }
+
+  if (shownShift != 0) {
+    // The real frame has caught up: fade to it from the last warped image.
+    shownShift = 0;
+    blending = true;
+    blendStart = now;
+  }
+
+  if (blending) {
+    const float alpha = std::chrono::duration<float>(now - blendStart) / blendDuration;
+    if (alpha < 1.f) {
+      const cv::Mat warped(h, w, CV_8UC(ch), warpBuffer.data());
+      const cv::Mat real(h, w, CV_8UC(ch), (void*)shownPixels());
+      cv::Mat blended(h, w, CV_8UC(ch), blendBuffer.data());
+      cv::addWeighted(warped, 1.f - alpha, real, alpha, 0.0, blended);
+      uploadTexture(blendBuffer.data());
+      parentScreen->redraw(); // Keep drawing until the fade completes.
+      return;
+    }
+    blending = false;
+  }
+
+  uploadTexture(shownPixels());
+}
+
+void VideoPreviewWindow::uploadTexture(const std::uint8_t* data) {
+  if (displayLut.empty()) {
+    texture->upload(data);
+    return;
+  }
+  {
+    TRACE_SCOPE("toneMap");
+    metrics::ScopedTimer timer(toneMapTime);
+    const int ch = texture->channels();
+    const cv::Mat encoded(frameHeight, frameWidth, CV_8UC(ch), (void*)data);
+    cv::Mat display(frameHeight, frameWidth, CV_8UC(ch), displayBuffer.data());
+    cv::LUT(encoded, displayLut, display);
+  }
+  texture->upload(displayBuffer.data());
+}
+
+bool VideoPreviewWindow::presentPacedFrame() {
+  std::lock_guard<std::mutex> lock(bufferMutex);
+  if (!framePacing) {
+    return false;
+  }
+  auto* frame = jitterBuffer.present(std::chrono::steady_clock::now());
+  if (jitterBuffer.pending()) {
+    parentScreen->redraw(); // Keep drawing (at the display rate) until the queued frames are due.
+  }
+  if (frame == nullptr) {
+    return false;
+  }
+  shownFrame = frame;
+  frameValueKnown = frame->valueKnown;
+  frameValue = frame->value;
+  return true;
+}
+
+const std::uint8_t* VideoPreviewWindow::shownPixels() const {
+  return shownFrame != nullptr ? shownFrame->pixels.data() : bgrBuffer.data();
+}
+
 void VideoPreviewWindow::draw(NVGcontext* ctx) {
-  // Upload latest buffer contents to video texture:
-  if (texture != nullptr) {
-    std::lock_guard<std::mutex> lock(bufferMutex);
-    texture->upload(bgrBuffer.data());
+  TRACE_SCOPE("VideoPreviewWindow::draw");
+  if (texture == nullptr && streamReady) {
+    createTexture();
+  }
+  if (texture == nullptr && statusLabel != nullptr && negotiationDone && !streamReady) {
+    statusLabel->set_caption("No video.");
+  }
+  // Upload latest buffer contents to video texture (if they changed):
+  bool newFrame = newFrameDecoded.exchange(false);
+  if (texture != nullptr && framePacing) {
+    newFrame = presentPacedFrame() || newFrame;
+  }
+  if (newFrame) {
+    // Held tiles or a full jitter buffer may be able to decode again:
+    decodePool->notify();
+  }
+  if (texture != nullptr && (newFrame || predicting || blending || displayChanged)) {
+    displayChanged = false;
+    uploadFrame(newFrame);
+    if (newFrame) {
+      // Time between frames actually shown (the judder that pacing removes):
+      const auto now = std::chrono::steady_clock::now();
+      presentInterval.record(std::chrono::duration<double, std::milli>(now - lastPresentTime).count());
+      lastPresentTime = now;
+    }
+    if (newFrame && !firstFrameShown) {
+      firstFrameShown = true;
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+      timeToFirstFrame.set(ms);
+      BOOST_LOG_TRIVIAL(info) << "Time to first frame for " << videoClient->streamName() << ": " << ms << " ms";
+    }
   }
 
   nanogui::Window::draw(ctx);
+
+  if (showMetrics) {
+    overlay.draw(ctx, absolute_position(), size());
+  }
 }
@@ -5,47 +5,193 @@
 #include <nanogui/nanogui.h>
 #include <opencv2/imgproc.hpp>
 
+#include "DecodePool.hpp"
+#include "JitterBuffer.hpp"
+#include "MetricsOverlay.hpp"
+#include "ToneMapping.hpp"
 #include "VideoClient.hpp"
 
 /// Window that receives an encoded video stream and displays
 /// it in a nanogui::ImageView that allows panning and zooming
-/// of the image. Video is decoded in a separate thread to keep
-/// the UI widgets responsive (although their effect will be
-/// limited by the video rate).
+/// of the image. Video is decoded by a pool of threads (shared
+/// with other streams) to keep the UI widgets responsive
+/// (although their effect will be limited by the video rate).
+/// A redraw of the screen is requested whenever a new frame
+/// is decoded and the texture is only uploaded for new frames.
+///
+/// The stream is negotiated on a background thread so the window
+/// shows a placeholder (and the UI stays responsive) until the
+/// server starts sending video. The time from construction until
+/// the first frame is displayed is reported in the metrics.
+///
+/// If reprojection is enabled then control values predicted locally (see
+/// predictValue()) are applied to the last decoded frame straight away by
+/// treating the value as a yaw angle in radians and rotating the image
+/// horizontally (exact for equirectangular environment renders). When a
+/// frame rendered with the predicted value arrives the display is blended
+/// from the warped image to the real one.
+///
+/// Log-encoded HDR streams are tone mapped when the texture is uploaded so
+/// exposure, gamma and tone curve changes (setDisplaySettings()) take effect
+/// on the next redraw without involving the server.
+///
+/// The image can be stitched together from horizontal bands (tiles) sent
+/// by several servers (see TileServers). Each tile is decoded independently
+/// straight into its rows of the buffer, but a tile that gets ahead of the
+/// others (by frame ID) is held back so that the texture is only updated
+/// with bands of the same frame. If the servers' frame IDs do not line up a
+/// held tile is released after a timeout (counted in <stream>_tile_sync_misses_total).
+///
+/// By default frames are shown as soon as they are decoded (lowest latency).
+/// With frame pacing enabled complete frames are copied into a JitterBuffer
+/// instead and shown at the cadence of the server's send times (for smooth
+/// playback of animations at the cost of some latency).
 class VideoPreviewWindow : public nanogui::Window {
 public:
-  VideoPreviewWindow(nanogui::Screen* screen, const std::string& title, PacketDemuxer& receiver);
+  /// @param tileClients Streams of the other bands if the image is tiled (the client streams the first band).
+  VideoPreviewWindow(nanogui::Screen* screen, const std::string& title,
+                     std::unique_ptr<VideoClient> client, std::shared_ptr<DecodePool> pool,
+                     std::vector<std::unique_ptr<VideoClient>> tileClients = {});
 
   virtual ~VideoPreviewWindow();
 
   virtual void draw(NVGcontext* ctx);
 
-  double getVideoBandwidthMbps() { return mbps; }
-  double getFrameRate() { return fps; }
+  double getVideoBandwidthMbps() { return mbps.get(); }
+  double getFrameRate() { return fps.get(); }
 
-  void reset() { imageView->reset(); }
+  /// Show/hide the per-stage timing graphs drawn over the video.
+  void toggleMetricsOverlay() { showMetrics = !showMetrics; }
+
+  /// Show/hide the window. Hidden streams are not decoded.
+  void setStreamVisible(bool visible);
+
+  void reset() {
+    if (imageView != nullptr) {
+      imageView->reset();
+    }
+  }
 
   cv::Mat getImage() const;
 
+  /// Enable/disable warping of the displayed frame to predicted values.
+  void setReprojection(bool enable);
+
+  /// Call (from the UI thread) when a new control value is sent to the server.
+  void predictValue(float radians);
+
+  /// Change the display transform for log-encoded streams (no effect on others).
+  void setDisplaySettings(const tonemap::DisplaySettings& settings);
+
+  /// Switch between showing frames as they arrive and at a steady rate.
+  void setFramePacing(bool enable);
+
 protected:
-  void startDecodeThread();
+  /// One band of the image and the stream it comes from (tile 0 is the
+  /// window's own client). Tiles are decoded by the pool independently.
+  struct Tile : public DecodePool::Source {
+    Tile(VideoPreviewWindow& w, VideoClient& c) : window(w), client(c) {}
+    bool readyToDecode() const override { return window.tileReadyToDecode(*this); }
+    std::chrono::steady_clock::time_point recheckTime() const override { return window.tileRecheckTime(*this); }
+    void decode() override { window.decodeVideoFrame(*this); }
+
+    VideoPreviewWindow& window;
+    VideoClient& client;
+    int top = 0;                                       // First row of the band in the stitched image.
+    std::atomic<bool> hasFrame{false};
+    std::atomic<std::uint64_t> frameId{0};             // ID of the frame currently in the band.
+    mutable std::atomic<std::int64_t> heldSinceMs{0};  // When the tile was first held back (0 if it is not).
+  };
+
+  bool tileReadyToDecode(const Tile& tile) const;
+  std::chrono::steady_clock::time_point tileRecheckTime(const Tile& tile) const;
+
+  /// Decode a video frame of the tile into its rows of the buffer.
+  void decodeVideoFrame(Tile& tile);
 
-  void stopDecodeThread();
+  /// True once every tile holds the same frame (must hold bufferMutex).
+  bool tilesInSync() const;
 
-  /// Decode a video frame into the buffer.
-  void decodeVideoFrame();
+  void negotiateStream();
+  void initialiseTiles();
+  void createTexture();
+
+  /// Upload the real or reprojected frame to the texture (UI thread only).
+  void uploadFrame(bool newFrame);
+
+  /// Upload an image to the texture via the display transform (if any).
+  void uploadTexture(const std::uint8_t* data);
+
+  /// Take the next due frame from the jitter buffer (UI thread only). Returns true if there is a new frame to show.
+  bool presentPacedFrame();
+
+  /// The frame on display: the paced frame or the latest decoded one (must hold bufferMutex).
+  const std::uint8_t* shownPixels() const;
 
 private:
+  nanogui::Screen* parentScreen;
   std::unique_ptr<VideoClient> videoClient;
+  std::vector<std::unique_ptr<VideoClient>> tileClients;
+  std::vector<std::unique_ptr<Tile>> tiles; // Fixed once the stream is ready.
+  metrics::Counter& tileSyncMisses;
+  int frameWidth;  // Size of the (stitched) image: set with the texture.
+  int frameHeight;
   std::vector<std::uint8_t> bgrBuffer;
   nanogui::Texture* texture;
   nanogui::ImageView* imageView;
-  double mbps;
+  metrics::SmoothedGauge& mbps;
   std::chrono::steady_clock::time_point m_lastFrameTime;
-  double fps;
+  metrics::SmoothedGauge& fps;
+  metrics::Histogram& decodeTime;
+  metrics::Histogram& convertTime;
+  metrics::Histogram& frameInterval;
+  metrics::Histogram& uploadTime;
+  metrics::Histogram& presentInterval;
+  std::chrono::steady_clock::time_point lastPresentTime;
+  MetricsOverlay overlay;
+  bool showMetrics;
 
-  std::unique_ptr<std::thread> videoDecodeThread;
+  std::shared_ptr<DecodePool> decodePool;
   std::mutex bufferMutex;
   std::atomic<bool> newFrameDecoded;
-  std::atomic<bool> runDecoderThread;
+  std::atomic<bool> decodeEnabled;
+
+  nanogui::Label* statusLabel;
+  std::atomic<bool> streamReady;
+  std::atomic<bool> stopNegotiation;
+  std::atomic<bool> negotiationDone;
+  std::chrono::steady_clock::time_point startTime;
+  metrics::Gauge& timeToFirstFrame;
+  bool firstFrameShown;
+  std::thread negotiationThread;
+
+  // Frame pacing (the shown frame is only used from the UI thread):
+  std::atomic<bool> framePacing;
+  JitterBuffer jitterBuffer;
+  JitterBuffer::Frame* shownFrame;
+
+  // Reprojection state (the frame value is written by the decode thread
+  // under bufferMutex, everything else is only used from the UI thread):
+  bool reprojection;
+  bool predicting;
+  float predictedValue;
+  std::chrono::steady_clock::time_point predictionTime;
+  bool frameValueKnown;
+  float frameValue;
+  bool decodedValueKnown; // Value of the latest decoded frame (may not be shown yet).
+  float decodedValue;
+  int shownShift;
+  bool blending;
+  std::chrono::steady_clock::time_point blendStart;
+  std::vector<std::uint8_t> warpBuffer;
+  std::vector<std::uint8_t> blendBuffer;
+  metrics::Counter& reprojectedFrames;
+
+  // Display transform for log-encoded streams (UI thread only):
+  packets::StreamInfo streamInfo;
+  tonemap::DisplaySettings displaySettings;
+  cv::Mat displayLut;
+  bool displayChanged;
+  std::vector<std::uint8_t> displayBuffer;
+  metrics::Histogram& toneMapTime;
 };
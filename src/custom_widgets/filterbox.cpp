@@ -0,0 +1,35 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include "filterbox.hpp"
+
+using namespace nanogui;
+
+FilterBox::FilterBox(Widget *parent, const std::string &placeholder)
+  : TextBox(parent, "")
+{
+  set_editable(true);
+  set_alignment(TextBox::Alignment::Left);
+  set_placeholder(placeholder);
+}
+
+bool FilterBox::keyboard_event(int key, int scancode, int action, int modifiers) {
+  bool handled = TextBox::keyboard_event(key, scancode, action, modifiers);
+  notify_if_changed();
+  return handled;
+}
+
+bool FilterBox::keyboard_character_event(unsigned int codepoint) {
+  bool handled = TextBox::keyboard_character_event(codepoint);
+  notify_if_changed();
+  return handled;
+}
+
+void FilterBox::notify_if_changed() {
+  // While editing nanogui holds the uncommitted text in m_value_temp:
+  if (m_value_temp != m_last_text) {
+    m_last_text = m_value_temp;
+    if (m_edit_callback) {
+      m_edit_callback(m_last_text);
+    }
+  }
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+/**
+ * A text box that reports its contents on every edit (rather than only
+ * when editing is committed) so that it can be used for type-ahead
+ * filtering of lists.
+ */
+
+#pragma once
+
+#include <nanogui/textbox.h>
+
+class FilterBox : public nanogui::TextBox {
+public:
+    FilterBox(nanogui::Widget *parent, const std::string &placeholder = "Filter...");
+
+    /// Sets the callback to execute whenever the text being edited changes.
+    void set_edit_callback(const std::function<void(const std::string&)> &callback) { m_edit_callback = callback; }
+
+    /// Handles key presses (e.g. backspace and delete) that can change the text.
+    virtual bool keyboard_event(int key, int scancode, int action, int modifiers) override;
+
+    /// Handles text input.
+    virtual bool keyboard_character_event(unsigned int codepoint) override;
+
+private:
+    void notify_if_changed();
+
+    std::string m_last_text;
+    std::function<void(const std::string&)> m_edit_callback;
+};
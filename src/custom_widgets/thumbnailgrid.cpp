@@ -0,0 +1,133 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#include <nanogui/theme.h>
+#include <nanogui/opengl.h>
+
+#include "thumbnailgrid.hpp"
+
+using namespace nanogui;
+
+ThumbnailGrid::ThumbnailGrid(Widget *parent, int columns, const Vector2i &cellSize)
+  : Widget(parent), m_columns(columns), m_cell_size(cellSize), m_spacing(4),
+    m_context(nullptr), m_image(0), m_atlas_width(0), m_atlas_height(0),
+    m_tile_width(0), m_tile_height(0), m_atlas_columns(0), m_tile_count(0),
+    m_selected(-1)
+{
+}
+
+ThumbnailGrid::~ThumbnailGrid() {
+  if (m_context != nullptr && m_image != 0) {
+    nvgDeleteImage(m_context, m_image);
+  }
+}
+
+void ThumbnailGrid::set_atlas(std::vector<std::uint8_t> &&rgba, int width, int height,
+                              int tileWidth, int tileHeight, int atlasColumns, int tileCount) {
+  m_pending_pixels = std::move(rgba);
+  m_atlas_width = width;
+  m_atlas_height = height;
+  m_tile_width = tileWidth;
+  m_tile_height = tileHeight;
+  m_atlas_columns = atlasColumns;
+  m_tile_count = tileCount;
+}
+
+void ThumbnailGrid::set_items(const std::vector<std::size_t> &tiles, const std::vector<std::string> &captions) {
+  m_tiles = tiles;
+  m_captions = captions;
+}
+
+Vector2i ThumbnailGrid::preferred_size(NVGcontext *) const {
+  const int rows = (m_tiles.size() + m_columns - 1) / m_columns;
+  return {m_columns * (m_cell_size.x() + m_spacing) + m_spacing,
+          std::max(rows, 1) * (m_cell_size.y() + m_spacing) + m_spacing};
+}
+
+int ThumbnailGrid::item_at(const Vector2i &p) const {
+  const int x = p.x() - m_pos.x() - m_spacing;
+  const int y = p.y() - m_pos.y() - m_spacing;
+  if (x < 0 || y < 0) {
+    return -1;
+  }
+  const int column = x / (m_cell_size.x() + m_spacing);
+  const int row = y / (m_cell_size.y() + m_spacing);
+  const int index = row * m_columns + column;
+  if (column >= m_columns || index >= (int)m_tiles.size()) {
+    return -1;
+  }
+  return index;
+}
+
+void ThumbnailGrid::draw(NVGcontext *ctx) {
+  Widget::draw(ctx);
+
+  // Upload the atlas as a single image the first time it is drawn:
+  if (!m_pending_pixels.empty()) {
+    if (m_image != 0) {
+      nvgDeleteImage(ctx, m_image);
+    }
+    m_image = nvgCreateImageRGBA(ctx, m_atlas_width, m_atlas_height, 0, m_pending_pixels.data());
+    m_context = ctx;
+    m_pending_pixels.clear();
+    m_pending_pixels.shrink_to_fit();
+  }
+
+  const float cw = m_cell_size.x(), ch = m_cell_size.y();
+  nvgFontSize(ctx, 12.f);
+  nvgFontFace(ctx, "sans");
+  nvgTextAlign(ctx, NVG_ALIGN_LEFT | NVG_ALIGN_BOTTOM);
+
+  for (std::size_t i = 0; i < m_tiles.size(); ++i) {
+    const float x = m_pos.x() + m_spacing + (i % m_columns) * (cw + m_spacing);
+    const float y = m_pos.y() + m_spacing + (i / m_columns) * (ch + m_spacing);
+    const int tile = m_tiles[i];
+
+    nvgBeginPath(ctx);
+    nvgRect(ctx, x, y, cw, ch);
+    if (m_image != 0 && tile < m_tile_count) {
+      // Position a pattern of the whole atlas so that just this tile covers the cell:
+      const float sx = cw / m_tile_width, sy = ch / m_tile_height;
+      const float tx = (tile % m_atlas_columns) * m_tile_width * sx;
+      const float ty = (tile / m_atlas_columns) * m_tile_height * sy;
+      nvgFillPaint(ctx, nvgImagePattern(ctx, x - tx, y - ty, m_atlas_width * sx, m_atlas_height * sy, 0.f, m_image, 1.f));
+    } else {
+      nvgFillColor(ctx, Color(48, 48, 48, 255));
+    }
+    nvgFill(ctx);
+
+    if (i < m_captions.size()) {
+      nvgSave(ctx);
+      nvgScissor(ctx, x, y, cw, ch);
+      nvgFillColor(ctx, Color(0, 0, 0, 255));
+      nvgText(ctx, x + 3, y + ch - 1, m_captions[i].c_str(), nullptr);
+      nvgFillColor(ctx, Color(255, 255, 255, 255));
+      nvgText(ctx, x + 2, y + ch - 2, m_captions[i].c_str(), nullptr);
+      nvgRestore(ctx);
+    }
+
+    if ((int)i == m_selected) {
+      nvgBeginPath(ctx);
+      nvgRect(ctx, x - 1.5f, y - 1.5f, cw + 3, ch + 3);
+      nvgStrokeWidth(ctx, 2.f);
+      nvgStrokeColor(ctx, Color(255, 255, 255, 192));
+      nvgStroke(ctx);
+    }
+  }
+}
+
+bool ThumbnailGrid::mouse_button_event(const Vector2i &p, int button, bool down, int modifiers) {
+  Widget::mouse_button_event(p, button, down, modifiers);
+  if (!m_enabled || button != GLFW_MOUSE_BUTTON_1 || !down) {
+    return false;
+  }
+
+  const int index = item_at(p);
+  if (index < 0) {
+    return false;
+  }
+  m_selected = index;
+  if (m_callback) {
+    m_callback(index);
+  }
+  return true;
+}
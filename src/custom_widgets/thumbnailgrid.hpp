@@ -0,0 +1,66 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+/**
+ * Displays a grid of selectable thumbnails. All thumbnails are drawn from
+ * a single atlas image which is uploaded to the GPU once.
+ */
+
+#pragma once
+
+#include <nanogui/widget.h>
+
+#include <cstdint>
+#include <vector>
+
+class ThumbnailGrid : public nanogui::Widget {
+public:
+    /**
+     * \param parent
+     *     The Widget to add this ThumbnailGrid to.
+     *
+     * \param columns
+     *     Number of thumbnails in each row of the grid.
+     *
+     * \param cellSize
+     *     Size in pixels at which each thumbnail is displayed.
+     */
+    ThumbnailGrid(nanogui::Widget *parent, int columns = 3, const nanogui::Vector2i &cellSize = {96, 48});
+    virtual ~ThumbnailGrid();
+
+    /// Set the atlas (RGBA pixels). The pixels are uploaded on the next draw and then released.
+    void set_atlas(std::vector<std::uint8_t> &&rgba, int width, int height,
+                   int tileWidth, int tileHeight, int atlasColumns, int tileCount);
+
+    /// Set the atlas tile index and caption of each item in the grid.
+    void set_items(const std::vector<std::size_t> &tiles, const std::vector<std::string> &captions);
+
+    void set_selected_index(int index) { m_selected = index; }
+
+    /// Sets the callback to execute with the index of the item that was clicked.
+    void set_callback(const std::function<void(int)> &callback) { m_callback = callback; }
+
+    virtual nanogui::Vector2i preferred_size(NVGcontext *ctx) const override;
+
+    virtual void draw(NVGcontext *ctx) override;
+
+    virtual bool mouse_button_event(const nanogui::Vector2i &p, int button, bool down, int modifiers) override;
+
+private:
+    int item_at(const nanogui::Vector2i &p) const;
+
+    int m_columns;
+    nanogui::Vector2i m_cell_size;
+    int m_spacing;
+
+    // Atlas state (m_image is the NanoVG handle once uploaded):
+    NVGcontext *m_context;
+    int m_image;
+    std::vector<std::uint8_t> m_pending_pixels;
+    int m_atlas_width, m_atlas_height;
+    int m_tile_width, m_tile_height, m_atlas_columns, m_tile_count;
+
+    std::vector<std::size_t> m_tiles;
+    std::vector<std::string> m_captions;
+    int m_selected;
+    std::function<void(int)> m_callback;
+};
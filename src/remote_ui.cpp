@@ -3,6 +3,7 @@
 #include <nanogui/nanogui.h>
 
 #include <PacketComms.h>
+#include <PacketSerialisation.h>
 #include <network/TcpSocket.h>
 
 #include <chrono>
@@ -14,11 +15,14 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
 
+#include "AssetCatalogue.hpp"
 #include "ControlsForm.hpp"
+#include "HeadlessClient.hpp"
+#include "PacketCapture.hpp"
 #include "RenderClientApp.hpp"
+#include "SharedFrameRing.hpp"
+#include "TileServers.hpp"
 #include "VideoPreviewWindow.hpp"
 #include "PacketDescriptions.hpp"
 #include "options.hpp"
@@ -30,6 +34,21 @@ boost::program_options::options_description getOptions() {
   ("help", "Show command help.")
   ("port", po::value<int>()->default_value(3000), "Port number to connect on.")
   ("host", po::value<std::string>()->default_value("localhost"), "Host to connect to.")
+  ("video-port", po::value<int>()->default_value(0), "Receive video on a separate connection to this port (must match the server's --video-port, 0 if video shares the main connection).")
+  ("tile-servers", po::value<std::string>()->default_value(""), "Comma separated host:port list of further servers that each render a horizontal band of the preview (the --host server renders the top band).")
+  ("no-shared-memory", po::bool_switch()->default_value(false), "Always receive encoded video (by default raw frames are read from shared memory if the server is on this host).")
+  ("nif-paths", po::value<std::string>()->default_value(""), "JSON file that maps display names to the paths of NIF assets on the remote.")
+  ("thumbnail-cache", po::value<std::string>()->default_value(".thumbnail_cache"), "Directory in which to cache NIF thumbnails received from the remote.")
+  ("record", po::value<std::string>()->default_value(""), "Record all packets received from the server to this capture file.")
+  ("replay", po::value<std::string>()->default_value(""), "Replay a capture file instead of connecting to a server (served on localhost using --port).")
+  ("replay-fast", po::bool_switch()->default_value(false), "Replay the capture as fast as possible instead of at the recorded pace.")
+  ("headless", po::bool_switch()->default_value(false), "Run without a window (receives and decodes video and applies any --script).")
+  ("script", po::value<std::string>()->default_value(""), "Control script to run in headless mode: one '<seconds> <type> [value]' change per line.")
+  ("frame-log", po::value<std::string>()->default_value(""), "In headless mode write per-frame timings to this CSV file.")
+  ("duration", po::value<int>()->default_value(0), "In headless mode exit after this many seconds (0 runs until the server disconnects).")
+  ("ping-interval", po::value<int>()->default_value(0), "In headless mode measure control round trip time with a ping every this many milliseconds (0 to disable).")
+  ("continuous-redraw", po::bool_switch()->default_value(false), "Redraw the UI at a fixed 60Hz instead of only when a new frame, input or status update arrives.")
+  ("decode-threads", po::value<std::size_t>()->default_value(2), "Number of threads used to decode video (shared by all streams).")
   ("log-level", po::value<std::string>()->default_value("info"), "Set the log level to one of the following: 'trace', 'debug', 'info', 'warn', 'err', 'critical', 'off'.")
   ("width,w", po::value<int>()->default_value(1600), "Main window width in pixels.")
   ("height,h", po::value<int>()->default_value(1200), "Main window height in pixels.");
@@ -52,7 +71,17 @@ int main(int argc, char** argv) {
 
     auto host = args.at("host").as<std::string>();
     auto port = args.at("port").as<int>();
-    auto socket = std::make_unique<TcpSocket>();
+
+    // In replay mode we connect to a local server that plays back a capture:
+    std::unique_ptr<PacketReplayServer> replayServer;
+    const auto replayFile = args.at("replay").as<std::string>();
+    if (!replayFile.empty()) {
+      host = "localhost";
+      replayServer = std::make_unique<PacketReplayServer>(replayFile, port, args.at("replay-fast").as<bool>());
+      replayServer->waitUntilListening();
+    }
+
+    auto socket = std::make_shared<TcpSocket>();
     bool connected = socket->Connect(host.c_str(), port);
     if (!connected) {
       BOOST_LOG_TRIVIAL(info) << "Could not conect to server " << host << ":" << port;
@@ -60,8 +89,89 @@ int main(int argc, char** argv) {
     }
     BOOST_LOG_TRIVIAL(info) << "Connected to server " << host << ":" << port;
 
-    auto sender = std::make_unique<PacketMuxer>(*socket, packets::packetTypes);
-    auto receiver = std::make_unique<PacketDemuxer>(*socket, packets::packetTypes);
+    // The muxers are shared with the UI's handshake thread (which can outlive
+    // the UI if it is closed before the server responds) so they keep the
+    // socket alive for as long as either of them exists:
+    auto deleteKeepingSocket = [socket](auto* p) { delete p; };
+    std::shared_ptr<PacketMuxer> sender(new PacketMuxer(*socket, packets::packetTypes), deleteKeepingSocket);
+    std::shared_ptr<PacketDemuxer> receiver(new PacketDemuxer(*socket, packets::packetTypes), deleteKeepingSocket);
+
+    // Optionally receive video on its own connection:
+    std::unique_ptr<TcpSocket> videoSocket;
+    std::unique_ptr<PacketDemuxer> videoReceiver;
+    const auto videoPort = args.at("video-port").as<int>();
+    if (videoPort != 0) {
+      videoSocket = std::make_unique<TcpSocket>();
+      if (!videoSocket->Connect(host.c_str(), videoPort)) {
+        BOOST_LOG_TRIVIAL(info) << "Could not conect to server video channel " << host << ":" << videoPort;
+        throw std::runtime_error("Unable to connect");
+      }
+      videoReceiver = std::make_unique<PacketDemuxer>(*videoSocket, packets::packetTypes);
+      BOOST_LOG_TRIVIAL(info) << "Connected to server video channel " << host << ":" << videoPort;
+    }
+    auto& videoRx = videoReceiver ? *videoReceiver : *receiver;
+
+    const auto recordFile = args.at("record").as<std::string>();
+
+    // Tell the server if we are on the same host so it can send video through
+    // shared memory (not when recording or replaying as those need real video):
+    const bool allowSharedMemory = !args.at("no-shared-memory").as<bool>() && recordFile.empty() && replayFile.empty();
+
+    // Optionally stitch the preview together from bands rendered by several servers:
+    std::shared_ptr<TileServers> tileServers;
+    const auto tileAddresses = TileServers::parseList(args.at("tile-servers").as<std::string>());
+    if (!tileAddresses.empty()) {
+      if (args.at("headless").as<bool>() || !replayFile.empty()) {
+        BOOST_LOG_TRIVIAL(warning) << "Tile servers are ignored in headless and replay modes.";
+      } else {
+        tileServers = std::make_shared<TileServers>(tileAddresses, allowSharedMemory);
+      }
+    }
+    const packets::TileAssignment mainTile{0, tileServers ? tileServers->tileCount() : 1};
+
+    auto& tx = *sender;
+    auto hostInfoSubscription = receiver->subscribe("server_info", [&tx, mainTile, allowSharedMemory](const ComPacket::ConstSharedPacket& packet) {
+      TileServers::answerServerInfo(tx, packet, mainTile, allowSharedMemory);
+    });
+
+    std::unique_ptr<PacketRecorder> recorder;
+    if (!recordFile.empty()) {
+      if (videoReceiver) {
+        BOOST_LOG_TRIVIAL(warning) << "Only packets on the main connection are recorded (video is on its own connection).";
+      }
+      recorder = std::make_unique<PacketRecorder>(*receiver, packets::packetTypes, recordFile);
+    }
+
+    if (args.at("headless").as<bool>()) {
+      std::vector<HeadlessClient::ControlEvent> script;
+      const auto scriptFile = args.at("script").as<std::string>();
+      if (!scriptFile.empty()) {
+        script = HeadlessClient::loadScript(scriptFile);
+      }
+      bool ok = false;
+      {
+        HeadlessClient client(*sender, *receiver, videoRx);
+        const auto frameLog = args.at("frame-log").as<std::string>();
+        if (!frameLog.empty()) {
+          client.logFrames(frameLog);
+        }
+        client.measureControlLatency(std::chrono::milliseconds(args.at("ping-interval").as<int>()));
+        ok = client.run(script, std::chrono::seconds(args.at("duration").as<int>()));
+      }
+      sender.reset();
+      videoReceiver.reset();
+      videoSocket.reset();
+      socket.reset();
+      // Scripted runs (e.g. in CI) need to see failures in the exit status:
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // The list of NIF assets available on the remote is loaded in the background:
+    std::unique_ptr<AssetCatalogue> nifCatalogue;
+    const auto nifFile = args.at("nif-paths").as<std::string>();
+    if (!nifFile.empty()) {
+      nifCatalogue = std::make_unique<AssetCatalogue>(nifFile);
+    }
 
     nanogui::init();
     BOOST_LOG_TRIVIAL(trace) << "Initialised nanogui";
@@ -70,17 +180,24 @@ int main(int argc, char** argv) {
       const auto w = args.at("width").as<int>();
       const auto h = args.at("height").as<int>();
       nanogui::Vector2i screenSize(w, h);
-      RenderClientApp app(screenSize, *sender, *receiver);
+      const auto thumbnailCacheDir = args.at("thumbnail-cache").as<std::string>();
+      RenderClientApp app(screenSize, sender, receiver, videoRx, nifCatalogue.get(), thumbnailCacheDir,
+                          args.at("decode-threads").as<std::size_t>(), tileServers);
       app.draw_all();
       app.set_visible(true);
       BOOST_LOG_TRIVIAL(trace) << "Entering nanogui main loop";
-      nanogui::mainloop(1 / 60.f * 1000);
+      // By default the UI is only redrawn on demand (a negative refresh disables polling):
+      const bool continuous = args.at("continuous-redraw").as<bool>();
+      nanogui::mainloop(continuous ? 1 / 60.f * 1000 : -1.f);
     }
 
     nanogui::shutdown();
 
     // Cleanly terminate the connection:
+    tileServers.reset();
     sender.reset();
+    videoReceiver.reset();
+    videoSocket.reset();
     socket.reset();
 
   } catch (const std::runtime_error& e) {
@@ -0,0 +1,270 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Loads assets on a background thread and keeps recently used assets in
+/// an LRU cache limited by a memory budget. The selected asset is always
+/// loaded first and is never evicted. Prefetch hints are loaded when the
+/// loader is otherwise idle so that switching to a neighbouring asset is
+/// near-instant. The asset type is opaque to this class: the application
+/// supplies a loader and a function that reports the memory an asset uses.
+template <class Asset>
+class AssetManager {
+public:
+    using AssetPtr = std::shared_ptr<const Asset>;
+    /// Called by the loader with progress in [0, 1]. If this returns false
+    /// the load is no longer wanted and the loader should return nullptr.
+    using ProgressCallback = std::function<bool(float)>;
+    using Loader = std::function<AssetPtr(const std::string& path, const ProgressCallback&)>;
+    using SizeFunction = std::function<std::size_t(const Asset&)>;
+    /// Reports load progress of the selected asset (progress is 1 once it is available).
+    /// If the load fails error describes why (it is empty otherwise).
+    using StatusCallback = std::function<void(const std::string& path, float progress, const std::string& error)>;
+
+    AssetManager(Loader assetLoader, SizeFunction assetSize, std::size_t budgetBytes)
+        : loader(assetLoader),
+          sizeOf(assetSize),
+          budget(budgetBytes),
+          usedBytes(0),
+          selectionGeneration(0),
+          running(true),
+          thread(&AssetManager::loaderLoop, this) {}
+
+    virtual ~AssetManager() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        workAvailable.notify_all();
+        thread.join();
+    }
+
+    void setStatusCallback(StatusCallback callback) {
+        std::lock_guard<std::mutex> lock(mutex);
+        statusCallback = callback;
+    }
+
+    /// Make the asset at path the current one. If it is cached the switch
+    /// is immediate, otherwise it is loaded ahead of any prefetches.
+    void select(const std::string& path) {
+        StatusCallback callback;
+        bool cached = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (path != selected) {
+                selectionGeneration += 1; // Abandons the load of the previous selection.
+            }
+            selected = path;
+            failed.clear(); // Selecting a failed asset again retries it.
+            auto itr = cache.find(path);
+            cached = itr != cache.end();
+            if (cached) {
+                touch(itr->second);
+                current = itr->second.asset;
+                callback = statusCallback;
+            }
+        }
+        BOOST_LOG_TRIVIAL(debug) << "Asset selected: " << path << (cached ? " (cached)" : "");
+        if (callback) {
+            callback(path, 1.f, std::string());
+        }
+        workAvailable.notify_all();
+    }
+
+    /// Replace the list of assets that should be loaded in the background
+    /// (in priority order). Assets already cached are skipped.
+    void prefetch(const std::vector<std::string>& paths) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            prefetchQueue.assign(paths.begin(), paths.end());
+        }
+        workAvailable.notify_all();
+    }
+
+    /// @return The current asset or nullptr if nothing has been loaded yet.
+    /// Note this is the most recently available selection so it can lag
+    /// behind select() while a new asset is loading.
+    AssetPtr getCurrent() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+
+    /// @return true if the selected asset is available.
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !selected.empty() && cache.count(selected) != 0;
+    }
+
+    /// @return true unless the selected asset is still loading (i.e. it is
+    /// available, failed to load or nothing is selected).
+    bool settled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return selectionSettled();
+    }
+
+    std::size_t bytesUsed() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return usedBytes;
+    }
+
+private:
+    struct Entry {
+        AssetPtr asset;
+        std::size_t bytes;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    /// Must be called with the mutex held.
+    bool selectionSettled() const {
+        return selected.empty() || selected == failed || cache.count(selected) != 0;
+    }
+
+    void touch(Entry& entry) {
+        lru.splice(lru.begin(), lru, entry.lruPosition);
+    }
+
+    /// Evict least recently used assets until the budget is met. The
+    /// selected asset is never evicted even if it alone exceeds the budget.
+    void evict() {
+        auto itr = lru.end();
+        while (usedBytes > budget && itr != lru.begin()) {
+            --itr;
+            if (*itr == selected) {
+                continue;
+            }
+            auto entry = cache.find(*itr);
+            usedBytes -= entry->second.bytes;
+            BOOST_LOG_TRIVIAL(debug) << "Evicting asset from cache: " << *itr;
+            cache.erase(entry);
+            itr = lru.erase(itr);
+        }
+    }
+
+    /// Choose the next path to load. Must be called with the mutex held.
+    /// @return empty string if there is nothing to do.
+    std::string nextJob(bool& isSelection) {
+        if (!selectionSettled()) {
+            isSelection = true;
+            return selected;
+        }
+        isSelection = false;
+        while (!prefetchQueue.empty()) {
+            std::string path = prefetchQueue.front();
+            prefetchQueue.pop_front();
+            if (cache.count(path) == 0) {
+                return path;
+            }
+        }
+        return std::string();
+    }
+
+    void loaderLoop() {
+        BOOST_LOG_TRIVIAL(debug) << "Asset loader thread launched.";
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            bool isSelection = false;
+            const std::string path = nextJob(isSelection);
+            if (path.empty()) {
+                workAvailable.wait(lock);
+                continue;
+            }
+            auto callback = statusCallback;
+            const std::uint64_t generation = selectionGeneration;
+            lock.unlock();
+
+            // Selections are abandoned if something else is selected and
+            // prefetches if the user selects something that is not cached:
+            ProgressCallback progress = [&](float fraction) {
+                if (isSelection) {
+                    if (selectionGeneration != generation) {
+                        return false;
+                    }
+                    if (callback) {
+                        callback(path, std::min(fraction, 0.99f), std::string());
+                    }
+                    return (bool)running;
+                }
+                std::lock_guard<std::mutex> guard(mutex);
+                return running && selectionSettled();
+            };
+
+            BOOST_LOG_TRIVIAL(info) << (isSelection ? "Loading asset: " : "Prefetching asset: ") << path;
+            AssetPtr asset;
+            std::string error = "Load failed";
+            try {
+                asset = loader(path, progress);
+            } catch (const std::exception& e) {
+                BOOST_LOG_TRIVIAL(error) << "Failed to load asset '" << path << "': " << e.what();
+                error = e.what();
+            }
+
+            lock.lock();
+            if (asset == nullptr) {
+                if (isSelection && selected == path && running) {
+                    // Do not retry a failed selection until it is requested again:
+                    failed = path;
+                    callback = statusCallback;
+                    lock.unlock();
+                    if (callback) {
+                        callback(path, 0.f, error);
+                    }
+                    lock.lock();
+                }
+                continue;
+            }
+
+            const std::size_t bytes = sizeOf(*asset);
+            lru.push_front(path);
+            cache[path] = Entry{asset, bytes, lru.begin()};
+            usedBytes += bytes;
+            evict();
+            BOOST_LOG_TRIVIAL(debug) << "Asset cache using " << usedBytes << "/" << budget << " bytes.";
+
+            if (selected == path) {
+                current = asset;
+                callback = statusCallback;
+                lock.unlock();
+                if (callback) {
+                    callback(path, 1.f, std::string());
+                }
+                lock.lock();
+            }
+        }
+        BOOST_LOG_TRIVIAL(debug) << "Asset loader thread exiting.";
+    }
+
+    Loader loader;
+    SizeFunction sizeOf;
+    const std::size_t budget;
+    std::size_t usedBytes;
+    StatusCallback statusCallback;
+
+    std::string selected;
+    std::string failed; // Selected asset that failed to load (not retried until selected again).
+    AssetPtr current;
+    std::deque<std::string> prefetchQueue;
+    std::unordered_map<std::string, Entry> cache;
+    std::list<std::string> lru; // Most recently used at the front.
+    std::atomic<std::uint64_t> selectionGeneration; // Changes whenever a different asset is selected.
+
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::atomic<bool> running;
+    std::thread thread;
+};
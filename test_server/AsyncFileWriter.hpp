@@ -0,0 +1,131 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <boost/log/trivial.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Appends data to a file from a background I/O thread using large
+/// buffered writes so that callers never wait for the disk. If the disk
+/// can not keep up and too many buffers are queued the writer stops
+/// (rather than leaving gaps in the file) and reports failure.
+class AsyncFileWriter {
+public:
+    AsyncFileWriter(const std::string& fileName,
+                    std::size_t bufferBytes = 8 * 1024 * 1024,
+                    std::size_t maxQueuedBuffers = 8)
+        : bufferSize(bufferBytes),
+          maxQueued(maxQueuedBuffers),
+          bytesQueued(0),
+          failed(false),
+          running(true) {
+        file.open(fileName, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not open '" + fileName + "' for writing.");
+        }
+        current.reserve(bufferSize);
+        thread = std::thread(&AsyncFileWriter::ioLoop, this);
+        BOOST_LOG_TRIVIAL(info) << "Writing to " << fileName << " in the background.";
+    }
+
+    /// Flushes all queued data before returning.
+    virtual ~AsyncFileWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!current.empty()) {
+                full.push_back(std::move(current));
+            }
+            running = false;
+        }
+        buffersQueued.notify_one();
+        thread.join();
+        BOOST_LOG_TRIVIAL(info) << "Background writer finished: " << bytesQueued << " bytes.";
+    }
+
+    /// Copy data into the current buffer (only blocks for the copy).
+    /// @return false if the writer has failed and the data was discarded.
+    bool write(const std::uint8_t* data, std::size_t size) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (failed) {
+            return false;
+        }
+        if (current.size() + size > bufferSize && !current.empty()) {
+            if (full.size() >= maxQueued) {
+                failed = true;
+                BOOST_LOG_TRIVIAL(error) << "Disk writes can not keep up: stopping background writer.";
+                return false;
+            }
+            full.push_back(std::move(current));
+            current = takeSpare();
+            lock.unlock();
+            buffersQueued.notify_one();
+            lock.lock();
+        }
+        current.insert(current.end(), data, data + size);
+        bytesQueued += size;
+        return true;
+    }
+
+    bool ok() const { return !failed; }
+
+private:
+    /// Reuse a buffer the I/O thread has finished with to avoid allocations.
+    /// Must be called with the mutex held.
+    std::vector<std::uint8_t> takeSpare() {
+        std::vector<std::uint8_t> buffer;
+        if (!spare.empty()) {
+            buffer = std::move(spare.back());
+            spare.pop_back();
+        }
+        buffer.clear();
+        buffer.reserve(bufferSize);
+        return buffer;
+    }
+
+    void ioLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            buffersQueued.wait(lock, [this]() { return !full.empty() || !running; });
+            if (full.empty() && !running) {
+                break;
+            }
+            auto buffer = std::move(full.front());
+            full.pop_front();
+            lock.unlock();
+
+            file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            if (!file) {
+                BOOST_LOG_TRIVIAL(error) << "Background file write failed.";
+            }
+
+            lock.lock();
+            if (!file) {
+                failed = true;
+            }
+            spare.push_back(std::move(buffer));
+        }
+        file.flush();
+    }
+
+    const std::size_t bufferSize;
+    const std::size_t maxQueued;
+    std::ofstream file;
+    std::vector<std::uint8_t> current;
+    std::deque<std::vector<std::uint8_t>> full;
+    std::vector<std::vector<std::uint8_t>> spare;
+    std::uint64_t bytesQueued;
+    std::atomic<bool> failed;
+    bool running;
+    std::mutex mutex;
+    std::condition_variable buffersQueued;
+    std::thread thread;
+};
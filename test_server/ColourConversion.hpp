@@ -0,0 +1,227 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <ToneMapping.hpp>
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Colour conversion from the layouts a renderer produces to what the
+/// encoders need, without intermediate full frame copies. Frames are split
+/// into bands of row pairs that are converted in parallel, and the inner
+/// loops use fixed point arithmetic without divisions so that they
+/// vectorise.
+///
+/// YUV output is I420 (planar 4:2:0) with BT.601 limited range coefficients
+/// which is what swscale produces from BGR for the MPEG-4 encoder.
+namespace colour {
+
+/// Pixel layout of a source image. The half float layouts hold linear
+/// light and are tone mapped as part of the conversion.
+enum class Layout { BGR, RGB, BGRA, RGBA, HalfRGB, HalfRGBA };
+
+inline Layout parseLayout(const std::string& name) {
+    if (name == "bgr") { return Layout::BGR; }
+    if (name == "rgb") { return Layout::RGB; }
+    if (name == "bgra") { return Layout::BGRA; }
+    if (name == "rgba") { return Layout::RGBA; }
+    if (name == "rgb_f16") { return Layout::HalfRGB; }
+    if (name == "rgba_f16") { return Layout::HalfRGBA; }
+    throw std::runtime_error("Unknown pixel layout: '" + name + "'");
+}
+
+inline int channels(Layout layout) {
+    return layout == Layout::BGR || layout == Layout::RGB || layout == Layout::HalfRGB ? 3 : 4;
+}
+
+inline bool isHalf(Layout layout) {
+    return layout == Layout::HalfRGB || layout == Layout::HalfRGBA;
+}
+
+/// Contiguous I420 image: the Y plane followed by the U and V planes.
+struct I420Frame {
+    std::vector<std::uint8_t> data;
+    int width = 0;
+    int height = 0;
+
+    void create(int w, int h) {
+        if (w % 2 || h % 2) {
+            throw std::runtime_error("I420 frames must have an even width and height.");
+        }
+        width = w;
+        height = h;
+        data.resize(std::size_t(w) * h * 3 / 2);
+    }
+    std::uint8_t* y() { return data.data(); }
+    std::uint8_t* u() { return y() + std::size_t(width) * height; }
+    std::uint8_t* v() { return u() + std::size_t(width / 2) * (height / 2); }
+};
+
+/// Maps linear values to tone mapped 8-bit values. The table is indexed by
+/// sqrt(x / maxLinear) so that dark values (where the display transform is
+/// steepest) get most of the entries.
+class ToneLut {
+public:
+    static constexpr int size = 4096;
+    static constexpr float maxLinear = 16.f;
+
+    ToneLut() : ToneLut(tonemap::DisplaySettings()) {}
+
+    ToneLut(const tonemap::DisplaySettings& toneSettings) : settings(toneSettings) {
+        for (int i = 0; i < size; ++i) {
+            const float s = float(i) / (size - 1);
+            const float display = std::pow(tonemap::applyCurve(s * s * maxLinear, settings.curve), 1.f / settings.gamma);
+            table[i] = cv::saturate_cast<std::uint8_t>(255.f * display);
+        }
+        scale = std::exp2(settings.exposure) / maxLinear;
+    }
+
+    bool matches(const tonemap::DisplaySettings& other) const {
+        return other.exposure == settings.exposure && other.gamma == settings.gamma && other.curve == settings.curve;
+    }
+
+    /// Tone map count linear values into 8-bit values.
+    void apply(const float* in, std::uint8_t* out, int count) const {
+        for (int i = 0; i < count; ++i) {
+            const float s = std::sqrt(std::clamp(in[i] * scale, 0.f, 1.f));
+            out[i] = table[int(s * (size - 1) + 0.5f)];
+        }
+    }
+
+private:
+    tonemap::DisplaySettings settings;
+    float scale;
+    std::array<std::uint8_t, size> table;
+};
+
+/// The table for DisplaySettings' defaults (built once).
+inline const ToneLut& defaultToneLut() {
+    static const ToneLut lut;
+    return lut;
+}
+
+namespace detail {
+
+/// Convert two rows of packed 8-bit pixels (channel offsets R, G, B with
+/// stride C) into two rows of Y and one row each of U and V.
+template <int C, int R, int G, int B>
+void rowPairToI420(const std::uint8_t* row0, const std::uint8_t* row1, int width,
+                   std::uint8_t* y0, std::uint8_t* y1, std::uint8_t* u, std::uint8_t* v) {
+    for (int x = 0; x < width; ++x) {
+        const std::uint8_t* p0 = row0 + C * x;
+        const std::uint8_t* p1 = row1 + C * x;
+        y0[x] = ((66 * p0[R] + 129 * p0[G] + 25 * p0[B] + 128) >> 8) + 16;
+        y1[x] = ((66 * p1[R] + 129 * p1[G] + 25 * p1[B] + 128) >> 8) + 16;
+    }
+    for (int x = 0; x < width / 2; ++x) {
+        const std::uint8_t* p0 = row0 + 2 * C * x;
+        const std::uint8_t* p1 = row1 + 2 * C * x;
+        // Sums of 2x2 blocks (so the coefficients are scaled by 4):
+        const int r = p0[R] + p0[C + R] + p1[R] + p1[C + R];
+        const int g = p0[G] + p0[C + G] + p1[G] + p1[C + G];
+        const int b = p0[B] + p0[C + B] + p1[B] + p1[C + B];
+        u[x] = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+        v[x] = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+    }
+}
+
+template <int C, int R, int G, int B>
+void packedToI420(const cv::Mat& image, I420Frame& out) {
+    const int width = image.cols;
+    cv::parallel_for_(cv::Range(0, image.rows / 2), [&](const cv::Range& pairs) {
+        for (int p = pairs.start; p < pairs.end; ++p) {
+            rowPairToI420<C, R, G, B>(image.ptr<std::uint8_t>(2 * p), image.ptr<std::uint8_t>(2 * p + 1), width,
+                                      out.y() + std::size_t(2 * p) * width, out.y() + std::size_t(2 * p + 1) * width,
+                                      out.u() + std::size_t(p) * (width / 2), out.v() + std::size_t(p) * (width / 2));
+        }
+    });
+}
+
+/// Tone map a row of half float pixels into packed 8-bit pixels in the
+/// same channel order (scratch is per thread so the pool never allocates).
+inline void toneMapRow(const cv::Mat& image, int y, const ToneLut& lut, std::uint8_t* out) {
+    thread_local cv::Mat linear;
+    const int count = image.cols * image.channels();
+    cv::Mat(1, count, CV_16F, const_cast<std::uint8_t*>(image.ptr<std::uint8_t>(y))).convertTo(linear, CV_32F);
+    lut.apply(linear.ptr<float>(), out, count);
+}
+
+} // end namespace detail
+
+/// Convert an image in any of the layouts to I420. Half float images are
+/// tone mapped with lut on the way (one row pair at a time).
+inline void toI420(const cv::Mat& image, Layout layout, I420Frame& out, const ToneLut& lut = defaultToneLut()) {
+    if (image.channels() != channels(layout) || (image.depth() == CV_16F) != isHalf(layout)) {
+        throw std::runtime_error("Image does not match the pixel layout.");
+    }
+    out.create(image.cols, image.rows);
+    switch (layout) {
+    case Layout::BGR: detail::packedToI420<3, 2, 1, 0>(image, out); break;
+    case Layout::RGB: detail::packedToI420<3, 0, 1, 2>(image, out); break;
+    case Layout::BGRA: detail::packedToI420<4, 2, 1, 0>(image, out); break;
+    case Layout::RGBA: detail::packedToI420<4, 0, 1, 2>(image, out); break;
+    case Layout::HalfRGB:
+    case Layout::HalfRGBA: {
+        const int c = channels(layout);
+        const int width = image.cols;
+        cv::parallel_for_(cv::Range(0, image.rows / 2), [&](const cv::Range& pairs) {
+            thread_local std::vector<std::uint8_t> rows;
+            rows.resize(std::size_t(2) * width * c);
+            std::uint8_t* row0 = rows.data();
+            std::uint8_t* row1 = row0 + std::size_t(width) * c;
+            for (int p = pairs.start; p < pairs.end; ++p) {
+                detail::toneMapRow(image, 2 * p, lut, row0);
+                detail::toneMapRow(image, 2 * p + 1, lut, row1);
+                std::uint8_t* y0 = out.y() + std::size_t(2 * p) * width;
+                std::uint8_t* u = out.u() + std::size_t(p) * (width / 2);
+                std::uint8_t* v = out.v() + std::size_t(p) * (width / 2);
+                if (c == 3) {
+                    detail::rowPairToI420<3, 0, 1, 2>(row0, row1, width, y0, y0 + width, u, v);
+                } else {
+                    detail::rowPairToI420<4, 0, 1, 2>(row0, row1, width, y0, y0 + width, u, v);
+                }
+            }
+        });
+        break;
+    }
+    }
+}
+
+/// Convert an image in any of the layouts to 8-bit BGR (for encoders that
+/// do not take YUV). out can be an existing (e.g. pooled) image.
+inline void toBgr(const cv::Mat& image, Layout layout, cv::Mat& out, const ToneLut& lut = defaultToneLut()) {
+    if (image.channels() != channels(layout) || (image.depth() == CV_16F) != isHalf(layout)) {
+        throw std::runtime_error("Image does not match the pixel layout.");
+    }
+    out.create(image.rows, image.cols, CV_8UC3);
+    const int width = image.cols;
+    const int c = channels(layout);
+    const bool bgrOrder = layout == Layout::BGR || layout == Layout::BGRA;
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) {
+        thread_local std::vector<std::uint8_t> toneMapped;
+        toneMapped.resize(std::size_t(width) * c);
+        for (int y = rows.start; y < rows.end; ++y) {
+            const std::uint8_t* in = image.ptr<std::uint8_t>(y);
+            if (isHalf(layout)) {
+                detail::toneMapRow(image, y, lut, toneMapped.data());
+                in = toneMapped.data();
+            }
+            std::uint8_t* o = out.ptr<std::uint8_t>(y);
+            for (int x = 0; x < width; ++x) {
+                o[3 * x + 0] = in[c * x + (bgrOrder ? 0 : 2)];
+                o[3 * x + 1] = in[c * x + 1];
+                o[3 * x + 2] = in[c * x + (bgrOrder ? 2 : 0)];
+            }
+        }
+    });
+}
+
+} // end namespace colour
@@ -0,0 +1,131 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/// Decides whether a frame is worth encoding by comparing it, tile by tile,
+/// against the last frame that was sent. Progressive renders change less and
+/// less as they converge so late in a render most frames can be skipped or
+/// sent at a reduced rate. A keep-alive frame is always sent periodically so
+/// the client does not time out waiting for video.
+///
+/// The comparison is against the last frame sent (not the last frame seen)
+/// so small changes accumulate until they are large enough to be sent. A
+/// throttled frame must still be sent once the rate limit allows (see
+/// throttledUntil()) in case it is the last frame the renderer produces.
+class DamageTracker {
+public:
+    struct Settings {
+        int tileSize = 64;
+        /// A tile is damaged if any channel of any pixel differs by more than this.
+        double threshold = 2.0;
+        /// Frames with less than this fraction of damaged tiles are rate limited.
+        float smallChangeFraction = 0.05f;
+        std::chrono::milliseconds smallChangeInterval{100};
+        /// Maximum time between frames even if nothing changes.
+        std::chrono::milliseconds keepAliveInterval{1000};
+    };
+
+    enum class Decision { Send, Throttle, Skip };
+
+    DamageTracker() : DamageTracker(Settings()) {}
+
+    DamageTracker(const Settings& trackerSettings)
+        : settings(trackerSettings), damagedFraction(1.f) {}
+
+    /// Compare the frame against the reference and decide what to do with it.
+    /// If the decision is Send the frame becomes the new reference.
+    Decision decide(const cv::Mat& frame, std::chrono::steady_clock::time_point now) {
+        measure(frame);
+        const auto sinceLastSent = now - lastSent;
+        if (damagedFraction == 0.f && sinceLastSent < settings.keepAliveInterval) {
+            return Decision::Skip;
+        }
+        if (damagedFraction < settings.smallChangeFraction && sinceLastSent < settings.smallChangeInterval) {
+            return Decision::Throttle;
+        }
+        updateReference(frame);
+        lastSent = now;
+        return Decision::Send;
+    }
+
+    /// Time from which a frame that was throttled can be sent.
+    std::chrono::steady_clock::time_point throttledUntil() const {
+        return lastSent + settings.smallChangeInterval;
+    }
+
+    /// Make the last frame passed to decide() (which was throttled) the
+    /// reference because it is being sent after all.
+    void sendThrottled(const cv::Mat& frame, std::chrono::steady_clock::time_point now) {
+        updateReference(frame);
+        lastSent = now;
+    }
+
+    /// Fraction of tiles that were damaged in the last call to decide().
+    float lastDamagedFraction() const { return damagedFraction; }
+
+private:
+    void measure(const cv::Mat& frame) {
+        if (reference.empty() || reference.rows != frame.rows || reference.cols != frame.cols ||
+            reference.type() != frame.type()) {
+            reference.create(frame.rows, frame.cols, frame.type());
+            tilesX = (frame.cols + settings.tileSize - 1) / settings.tileSize;
+            tilesY = (frame.rows + settings.tileSize - 1) / settings.tileSize;
+            damaged.assign(tilesX * tilesY, 1);
+            damagedFraction = 1.f;
+            return;
+        }
+
+        // Each tile is compared with cv::norm which uses SIMD internally:
+        cv::parallel_for_(cv::Range(0, tilesY), [&](const cv::Range& rows) {
+            for (int ty = rows.start; ty < rows.end; ++ty) {
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    const cv::Rect tile = tileRect(tx, ty);
+                    damaged[ty * tilesX + tx] =
+                        cv::norm(frame(tile), reference(tile), cv::NORM_INF) > settings.threshold;
+                }
+            }
+        });
+
+        std::size_t count = 0;
+        for (auto d : damaged) {
+            count += d;
+        }
+        damagedFraction = float(count) / damaged.size();
+    }
+
+    /// Only damaged tiles are copied: the others are within the threshold.
+    void updateReference(const cv::Mat& frame) {
+        cv::parallel_for_(cv::Range(0, tilesY), [&](const cv::Range& rows) {
+            for (int ty = rows.start; ty < rows.end; ++ty) {
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    if (damaged[ty * tilesX + tx]) {
+                        const cv::Rect tile = tileRect(tx, ty);
+                        cv::Mat destination = reference(tile);
+                        frame(tile).copyTo(destination);
+                    }
+                }
+            }
+        });
+    }
+
+    cv::Rect tileRect(int tx, int ty) const {
+        const int x = tx * settings.tileSize;
+        const int y = ty * settings.tileSize;
+        return cv::Rect(x, y, std::min(settings.tileSize, reference.cols - x), std::min(settings.tileSize, reference.rows - y));
+    }
+
+    const Settings settings;
+    cv::Mat reference;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<std::uint8_t> damaged;
+    float damagedFraction;
+    std::chrono::steady_clock::time_point lastSent;
+};
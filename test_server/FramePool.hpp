@@ -0,0 +1,82 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+/// A fixed set of pre-allocated frame buffers that are reused for every
+/// frame so that the send path makes no allocations in steady state. Rows
+/// are padded so that every row starts on an alignment boundary (suitable
+/// for SIMD colour conversion and the encoder's own SIMD code).
+///
+/// Buffers are reference counted: a buffer returns to the pool when the last
+/// reference to it is dropped so it can be held by asynchronous stages (or
+/// by Python) for as long as needed.
+class FramePool {
+public:
+    struct Buffer {
+        std::uint8_t* data;
+        int width;
+        int height;
+        int channels;
+        std::size_t step; // Bytes per row (including padding).
+
+        /// Wrap the buffer (without copying) as an 8-bit OpenCV image.
+        cv::Mat mat() const { return cv::Mat(height, width, CV_8UC(channels), data, step); }
+    };
+    using BufferPtr = std::shared_ptr<Buffer>;
+
+    FramePool(int width, int height, int channels = 3, std::size_t count = 3, std::size_t alignment = 64)
+        : state(std::make_shared<State>()) {
+        const std::size_t step = (width * channels + alignment - 1) / alignment * alignment;
+        for (std::size_t i = 0; i < count; ++i) {
+            void* memory = std::aligned_alloc(alignment, step * height);
+            if (memory == nullptr) {
+                throw std::bad_alloc();
+            }
+            state->storage.emplace_back(static_cast<std::uint8_t*>(memory), &std::free);
+            state->buffers.emplace_back(Buffer{state->storage.back().get(), width, height, channels, step});
+            state->available.push_back(&state->buffers.back());
+        }
+    }
+
+    /// Take a free buffer, blocking until one is returned if they are all in use.
+    BufferPtr acquire() {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->returned.wait(lock, [&]() { return !state->available.empty(); });
+        Buffer* buffer = state->available.back();
+        state->available.pop_back();
+        // The deleter keeps the pool's state alive so buffers can outlive the pool:
+        auto poolState = state;
+        return BufferPtr(buffer, [poolState](Buffer* b) {
+            {
+                std::lock_guard<std::mutex> lock(poolState->mutex);
+                poolState->available.push_back(b);
+            }
+            poolState->returned.notify_one();
+        });
+    }
+
+    int width() const { return state->buffers.front().width; }
+    int height() const { return state->buffers.front().height; }
+
+private:
+    struct State {
+        std::vector<std::unique_ptr<std::uint8_t, decltype(&std::free)>> storage;
+        std::deque<Buffer> buffers; // Deque so that pointers remain valid as buffers are added.
+        std::vector<Buffer*> available;
+        std::mutex mutex;
+        std::condition_variable returned;
+    };
+
+    std::shared_ptr<State> state;
+};
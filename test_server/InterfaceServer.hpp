@@ -7,6 +7,15 @@
 #include <VideoLib.h>
 #include <network/TcpSocket.h>
 #include <PacketDescriptions.hpp>
+#include <ToneMapping.hpp>
+#include <Trace.hpp>
+
+#include "AsyncFileWriter.hpp"
+#include "DamageTracker.hpp"
+#include "FramePool.hpp"
+#include "MetricsEndpoint.hpp"
+#include "ThumbnailAtlas.hpp"
+#include "VideoEncoder.hpp"
 
 #include <cereal/types/string.hpp>
 #include <cereal/types/vector.hpp>
@@ -15,16 +24,24 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include <thread>
 
+#include <unistd.h>
+
 using namespace std::chrono_literals;
 
 class InterfaceServer {
 
     // Set up communication channels and subscriptions and then enter a transmit/receive loop.
     void communicate() {
+        trace::setThreadName("interface_server");
 
         BOOST_LOG_TRIVIAL(info) << "User interface server opening port " << port;
         bool ok = serverSocket.Bind(port);
@@ -33,13 +50,31 @@ class InterfaceServer {
             ok = serverSocket.Listen(0);
         }
 
+        // The video channel must be listening before the client connects:
+        if (ok && videoPort != 0) {
+            BOOST_LOG_TRIVIAL(info) << "User interface server opening video port " << videoPort;
+            ok = videoServerSocket.Bind(videoPort) && videoServerSocket.Listen(0);
+        }
+
         if (ok) {
             BOOST_LOG_TRIVIAL(info) << "User interface server accepting connections...";
             connection = serverSocket.Accept();
         }
 
+        if (connection && videoPort != 0) {
+            videoConnection = videoServerSocket.Accept();
+            if (videoConnection) {
+                BOOST_LOG_TRIVIAL(debug) << "User interface client connected video channel.";
+                videoConnection->setBlocking(false);
+                videoSender.reset(new PacketMuxer(*videoConnection, packets::packetTypes));
+            } else {
+                connection.reset();
+            }
+        }
+
         if (connection) {
             BOOST_LOG_TRIVIAL(debug) << "User interface client connected.";
+            connectedClients.set(1);
             connection->setBlocking(false);
             PacketDemuxer receiver(*connection, packets::packetTypes);
             sender.reset(new PacketMuxer(*connection, packets::packetTypes));
@@ -47,42 +82,189 @@ class InterfaceServer {
             syncWithClient(*sender, receiver, "ready");
             BOOST_LOG_TRIVIAL(debug) << "Comms synchronised.";
 
-            // Lambda that enqueues video packets via the Muxing system:
-            FFMpegStdFunctionIO videoIO(FFMpegCustomIO::WriteBuffer, [&](uint8_t* buffer, int size) {
-                if (sender) {
-                    BOOST_LOG_TRIVIAL(debug) << "Sending compressed video packet of size: " << size;
-                    sender->emplacePacket("render_preview", reinterpret_cast<VectorStream::CharType*>(buffer), size);
-                    BOOST_LOG_TRIVIAL(trace) << "Sender return status: " << sender->ok();
-                    return sender->ok() ? size : -1;
+            // Optionally tee the main encoded stream (from its first byte) to disk:
+            if (!sessionFile.empty()) {
+                try {
+                    sessionRecorder.reset(new AsyncFileWriter(sessionFile));
+                } catch (const std::runtime_error& e) {
+                    BOOST_LOG_TRIVIAL(error) << "Session will not be recorded: " << e.what();
                 }
-                return -1;
-            });
-            videoStream.reset(new LibAvWriter(videoIO));
-            BOOST_LOG_TRIVIAL(debug) << "Video stream initialised.";
+            }
 
             auto subs1 = receiver.subscribe("stop",
                                             [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::lock_guard<std::mutex> lock(stateMutex);
                                                 deserialise(packet, state.stop);
                                                 BOOST_LOG_TRIVIAL(trace) << "Render stopped by remote UI.";
                                                 stateUpdated = true;
+                                                stateUpdates.add();
                                             });
 
             auto subs2 = receiver.subscribe("value",
                                             [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::lock_guard<std::mutex> lock(stateMutex);
                                                 deserialise(packet, state.value);
                                                 BOOST_LOG_TRIVIAL(trace) << "New value: " << state.value;
                                                 stateUpdated = true;
+                                                stateUpdates.add();
                                             });
 
+            auto subs3 = receiver.subscribe("samples",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::lock_guard<std::mutex> lock(stateMutex);
+                                                deserialise(packet, state.samples);
+                                                BOOST_LOG_TRIVIAL(trace) << "New samples per pass: " << state.samples;
+                                                stateUpdated = true;
+                                                stateUpdates.add();
+                                            });
+
+            auto subs4 = receiver.subscribe("load_nif",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::string path;
+                                                deserialise(packet, path);
+                                                BOOST_LOG_TRIVIAL(trace) << "New NIF selected: " << path;
+                                                std::lock_guard<std::mutex> lock(stateMutex);
+                                                state.nifPath = path;
+                                                stateUpdated = true;
+                                                stateUpdates.add();
+                                            });
+
+            auto subs5 = receiver.subscribe("prefetch_nifs",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::vector<std::string> paths;
+                                                deserialise(packet, paths);
+                                                BOOST_LOG_TRIVIAL(trace) << "Received " << paths.size() << " NIF prefetch hints.";
+                                                std::lock_guard<std::mutex> lock(stateMutex);
+                                                state.prefetchPaths = std::move(paths);
+                                                stateUpdated = true;
+                                                stateUpdates.add();
+                                            });
+
+            // Thumbnails can take a while to load so the atlas is built on the thumbnail service's thread:
+            auto subs6 = receiver.subscribe("thumbnail_request",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                packets::ThumbnailRequest request;
+                                                deserialise(packet, request);
+                                                BOOST_LOG_TRIVIAL(trace) << "Received request for " << request.paths.size() << " thumbnails.";
+                                                thumbnails.request(request, [this](const packets::ThumbnailAtlas& atlas) {
+                                                    serialise(*sender, "thumbnail_atlas", atlas);
+                                                });
+                                            });
+
+            auto subs7 = receiver.subscribe("stream_visibility",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                packets::StreamVisibility visibility;
+                                                deserialise(packet, visibility);
+                                                BOOST_LOG_TRIVIAL(debug) << "Video stream '" << visibility.stream << "' "
+                                                                         << (visibility.visible ? "resumed" : "paused") << " by remote UI.";
+                                                std::lock_guard<std::mutex> lock(streamsMutex);
+                                                streamVisibility[visibility.stream] = visibility.visible;
+                                            });
+
+            // Reply immediately so the client can measure control round trip time:
+            auto subs8 = receiver.subscribe("ping",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                std::int64_t timestamp = 0;
+                                                deserialise(packet, timestamp);
+                                                serialise(senderFor("pong"), "pong", timestamp);
+                                            });
+
+            // Find out if the client is on this host (clients that do not
+            // reply to the query get encoded video):
+            std::mutex hostMutex;
+            std::condition_variable hostReplied;
+            bool gotClientInfo = false;
+            auto subs9 = receiver.subscribe("client_info",
+                                            [&](const ComPacket::ConstSharedPacket& packet) {
+                                                packets::HostInfo client;
+                                                deserialise(packet, client);
+                                                BOOST_LOG_TRIVIAL(info) << "Client host: " << client.hostName
+                                                                        << (client.sharedMemory ? " (video via shared memory)" : "");
+                                                clientSharedMemory = client.sharedMemory && sharedMemoryAllowed;
+                                                {
+                                                    std::lock_guard<std::mutex> lock(hostMutex);
+                                                    gotClientInfo = true;
+                                                }
+                                                hostReplied.notify_all();
+                                            });
+            // Clients that stitch video from several servers say which band
+            // of the image this one renders (before they send client_info):
+            auto subs10 = receiver.subscribe("tile_assignment",
+                                             [&](const ComPacket::ConstSharedPacket& packet) {
+                                                 packets::TileAssignment assignment;
+                                                 deserialise(packet, assignment);
+                                                 if (assignment.count == 0 || assignment.index >= assignment.count) {
+                                                     BOOST_LOG_TRIVIAL(error) << "Ignoring invalid tile assignment.";
+                                                     return;
+                                                 }
+                                                 BOOST_LOG_TRIVIAL(info) << "Rendering tile " << assignment.index + 1
+                                                                         << " of " << assignment.count;
+                                                 tile = assignment;
+                                             });
+            // A matching host name does not mean the client can see this
+            // process's shared memory (e.g. separate containers) so it has to
+            // open a probe segment first:
+            packets::HostInfo hostInfo{localHostName(), sharedMemoryAllowed, ""};
+            std::unique_ptr<SharedFrameRing> probe;
+            if (sharedMemoryAllowed) {
+                hostInfo.probe = "/remote_ui_" + std::to_string(getpid()) + "_" + std::to_string(port) + "_probe";
+                try {
+                    probe = std::make_unique<SharedFrameRing>(SharedFrameRing::create(hostInfo.probe, 1, 1, 1, 1));
+                } catch (const std::exception& e) {
+                    BOOST_LOG_TRIVIAL(warning) << "Could not create shared memory: " << e.what();
+                    hostInfo.sharedMemory = false;
+                    hostInfo.probe.clear();
+                }
+            }
+            serialise(*sender, "server_info", hostInfo);
+            {
+                std::unique_lock<std::mutex> lock(hostMutex);
+                if (!hostReplied.wait_for(lock, 1s, [&]() { return gotClientInfo; })) {
+                    BOOST_LOG_TRIVIAL(warning) << "Client did not send its host info.";
+                }
+            }
+            probe.reset();
+
+            // Throttled frames are encoded on their own thread so that this one never encodes:
+            {
+                std::lock_guard<std::mutex> lock(throttleMutex);
+                throttleRunning = true;
+                nextThrottled = std::chrono::steady_clock::time_point::max();
+            }
+            std::thread throttleThread(&InterfaceServer::throttledFrameLoop, this);
+
             BOOST_LOG_TRIVIAL(info) << "User interface server entering Tx/Rx loop.";
             serverReady = true;
             while (serverReady && receiver.ok()) {
                 std::this_thread::sleep_for(5ms);
             }
             BOOST_LOG_TRIVIAL(info) << "User interface server Tx/Rx loop exited.";
-            // This needs to be freed while FFMpegStdFunctionIO is in scope in order
-            // to write a trailer to the stream:
-            videoStream.reset();
+            {
+                std::lock_guard<std::mutex> lock(throttleMutex);
+                throttleRunning = false;
+            }
+            throttleDue.notify_one();
+            throttleThread.join();
+            thumbnails.cancel();
+            {
+                // Encoders are freed while the sender still exists so that
+                // they can write a trailer to each stream (waiting for any
+                // frame that is being encoded):
+                std::map<std::string, std::shared_ptr<VideoStream>> streams;
+                {
+                    std::lock_guard<std::mutex> lock(streamsMutex);
+                    streams.swap(videoStreams);
+                    streamVisibility.clear();
+                }
+                for (auto& stream : streams) {
+                    std::lock_guard<std::mutex> lock(stream.second->encodeMutex);
+                    stream.second->encoder.reset();
+                }
+            }
+            sessionRecorder.reset();
+            clientSharedMemory = false;
+            tile = packets::TileAssignment();
+            connectedClients.set(0);
             serverReady = false;
         } else {
             BOOST_LOG_TRIVIAL(error) << "Failed to start user interface server.";
@@ -100,19 +282,36 @@ public:
     }
 
     struct State {
-        State() : value(1.f), stop(false) {}
+        State() : value(1.f), samples(1), stop(false) {}
         std::string toString() const{
-            return "State(value=" + std::to_string(value) + ", stop=" + std::to_string(stop) + ")";
+            return "State(value=" + std::to_string(value) + ", samples=" + std::to_string(samples) +
+                   ", nif_path='" + nifPath + "', prefetch_paths=" + std::to_string(prefetchPaths.size()) +
+                   ", stop=" + std::to_string(stop) + ")";
         }
 
         float value;
+        std::uint32_t samples;
+        std::string nifPath;
+        std::vector<std::string> prefetchPaths;
         bool stop;
     };
 
     InterfaceServer(int portNumber)
         : port(portNumber),
         serverReady(false),
-        stateUpdated(false) {}
+        stateUpdated(false),
+        renderedValue(State().value),
+        framesEncoded(metrics::registry().counter("frames_encoded_total")),
+        framesSkipped(metrics::registry().counter("frames_skipped_total")),
+        framesThrottled(metrics::registry().counter("frames_throttled_total")),
+        damagedFraction(metrics::registry().gauge("damaged_tile_fraction")),
+        framesFailed(metrics::registry().counter("frames_failed_total")),
+        videoPacketsSent(metrics::registry().counter("video_packets_sent_total")),
+        videoBytesSent(metrics::registry().counter("video_bytes_sent_total")),
+        stateUpdates(metrics::registry().counter("state_updates_total")),
+        connectedClients(metrics::registry().gauge("connected_clients")),
+        encodeTime(metrics::registry().histogram("encode_ms")),
+        muxerEnqueueTime(metrics::registry().histogram("muxer_enqueue_ms")) {}
 
     std::string toString() const {
         return "InterfaceServer(port=" + std::to_string(port) + ", ready=" + std::to_string(serverReady) + ")";
@@ -120,20 +319,74 @@ public:
 
     /// Return a copy of the state and mark it as consumed:
     State consumeState() {
+        std::lock_guard<std::mutex> lock(stateMutex);
         State tmp = state;
         stateUpdated = false;  // Clear the update flag.
+        renderedValue = tmp.value; // Frames sent from now on are assumed to use this value.
         return tmp;
     }
 
-    const State& getState() const {
+    /// Return a copy of the state (without marking it as consumed).
+    State getState() const {
+        std::lock_guard<std::mutex> lock(stateMutex);
         return state;
     }
 
+    /// Set the control value reported with the frames sent from now on. Only
+    /// needed if frames are rendered by another process (otherwise it is the
+    /// value returned by the last call to consumeState()).
+    void setRenderedValue(float value) {
+        renderedValue = value;
+    }
+
+    /// Set the ID reported with the frames sent from now on. By default each
+    /// stream numbers its frames from 0, but servers that render tiles of
+    /// the same image must give the tiles of each image the same ID (e.g. an
+    /// animation frame number) so that the client can stitch them together.
+    void setFrameId(std::uint64_t id) {
+        frameId = id;
+    }
+
+    /// The band of the image this server renders if the client stitches
+    /// video from several servers (count is 1 otherwise). Valid once
+    /// waitUntilReady() returns. Frames are still sent at full size (only
+    /// the band is encoded) so a renderer only needs to fill in its rows.
+    packets::TileAssignment tileAssignment() const {
+        return tile;
+    }
+
     /// Has the state changed since it was last consumed?:
     bool stateChanged() const {
         return stateUpdated;
     }
 
+    /// True from when waitUntilReady() succeeds until the client disconnects.
+    bool clientConnected() const {
+        return serverReady;
+    }
+
+    /// Save the encoded video stream to a file as it is sent (without
+    /// re-encoding). The file uses the same container as the stream so
+    /// can be played directly or remuxed with 'ffmpeg -i <file> -c copy'.
+    /// Must be called before start() so the stream header is captured.
+    void recordSession(const std::string& fileName) {
+        sessionFile = fileName;
+    }
+
+    /// Serve streaming health metrics in the Prometheus text format on a
+    /// second port (e.g. for 'curl http://localhost:<port>/metrics').
+    void serveMetrics(int metricsPort) {
+        metricsEndpoint.reset(new MetricsEndpoint(metrics::registry(), metricsPort, "interface_server_"));
+    }
+
+    /// Send video on a separate connection (accepted on videoPort after the
+    /// main connection) so that control and status packets never wait behind
+    /// large video packets. The client must connect to both ports. Must be
+    /// called before start().
+    void useVideoChannel(int videoPortNumber) {
+        videoPort = videoPortNumber;
+    }
+
     /// Launches the UI thread and blocks until a connection is
     /// made and all server state is initialised. Note that some
     /// server state can not be initialised until after the client
@@ -165,14 +418,194 @@ public:
         return connection != nullptr && serverReady;
     }
 
-    void initialiseVideoStream(std::size_t width, std::size_t height) {
-        if (videoStream) {
-        videoStream->AddVideoStream(width, height, 30, video::FourCc('F', 'M', 'P', '4'));
-        } else {
-        BOOST_LOG_TRIVIAL(warning) << "No object to add video stream to.";
+    /// Start a named video stream. The name must be one of packets::videoStreams
+    /// and the main stream is "render_preview". The codec selects the encoder
+    /// backend (see createVideoEncoder()): "libav" streams must have an even
+    /// width and height. Call after waitUntilReady().
+    /// @param transfer "srgb" if the stream will be sent display-ready images
+    /// (sendImage()) or "log" to send HDR images (sendHdrImage()) that the
+    /// client tone maps itself.
+    void initialiseVideoStream(std::size_t width, std::size_t height, const std::string& name = "render_preview", int fps = 30,
+                               const std::string& codec = "libav", const std::string& transfer = "srgb") {
+        if (!sender || !serverReady) {
+            BOOST_LOG_TRIVIAL(warning) << "No object to add video stream to.";
+            return;
+        }
+        if (std::find(packets::videoStreams.begin(), packets::videoStreams.end(), name) == packets::videoStreams.end()) {
+            BOOST_LOG_TRIVIAL(error) << "Unknown video stream name: " << name;
+            return;
+        }
+        if (transfer != "srgb" && transfer != "log") {
+            BOOST_LOG_TRIVIAL(error) << "Unknown transfer function: " << transfer;
+            return;
+        }
+        // Checked here rather than on the first frame (the encoder converts to
+        // 4:2:0 itself). Also checked when shared memory replaces the encoder
+        // so that a stream works the same for local and remote clients:
+        if (codec == "libav" && (width % 2 || height % 2)) {
+            BOOST_LOG_TRIVIAL(error) << "Video stream '" << name << "' must have an even width and height for codec "
+                                     << codec << " (not " << width << "x" << height << ").";
+            return;
+        }
+
+        // Only this server's band of the image is encoded:
+        const cv::Range bandRows(tile.top(height), tile.bottom(height));
+
+        // Clients on this host read raw frames from shared memory instead:
+        const std::string streamCodec = clientSharedMemory ? "shm" : codec;
+        const std::string ringName = clientSharedMemory ? "/remote_ui_" + std::to_string(getpid()) + "_" + name : "";
+
+        std::lock_guard<std::mutex> lock(streamsMutex);
+        if (videoStreams.count(name)) {
+            BOOST_LOG_TRIVIAL(warning) << "Video stream '" << name << "' is already initialised.";
+            return;
+        }
+        // The stream is only published once it is complete:
+        auto newStream = std::make_shared<VideoStream>();
+        auto& stream = *newStream;
+
+        // Lambda that enqueues video packets via the Muxing system:
+        const bool record = name == "render_preview" && streamCodec == "libav";
+        auto write = [this, name, record](uint8_t* buffer, int size) {
+            TRACE_SCOPE("InterfaceServer::sendVideoPacket");
+            if (record && sessionRecorder) {
+                sessionRecorder->write(buffer, size);
+            }
+            if (sender) {
+                BOOST_LOG_TRIVIAL(debug) << "Sending compressed video packet of size: " << size;
+                auto& videoSender = senderFor(name);
+                {
+                    metrics::ScopedTimer timer(muxerEnqueueTime);
+                    videoSender.emplacePacket(name, reinterpret_cast<VectorStream::CharType*>(buffer), size);
+                }
+                videoPacketsSent.add();
+                videoBytesSent.add(size);
+                BOOST_LOG_TRIVIAL(trace) << "Sender return status: " << videoSender.ok();
+                return videoSender.ok() ? size : -1;
+            }
+            return -1;
+        };
+        try {
+            stream.encoder = createVideoEncoder(streamCodec, width, bandRows.size(), fps, write, ringName);
+        } catch (const std::exception& e) {
+            BOOST_LOG_TRIVIAL(error) << e.what();
+            return;
+        }
+
+        // The client must know about the stream before its first packet arrives:
+        serialise(*sender, "video_stream", name);
+        packets::StreamInfo info{name, streamCodec, std::uint32_t(width), std::uint32_t(bandRows.size()), transfer};
+        info.sharedMemory = ringName;
+        if (tile.count > 1) {
+            info.tileTop = bandRows.start;
+            info.fullHeight = height;
+        }
+        serialise(senderFor("stream_info"), "stream_info", info);
+        stream.info = info;
+        stream.band = bandRows;
+        stream.frames = std::make_shared<FramePool>(width, height);
+        videoStreams[name] = newStream;
+        BOOST_LOG_TRIVIAL(debug) << "Video stream '" << name << "' initialised.";
+    }
+
+    /// Get a pre-allocated frame buffer for the named stream to render into.
+    /// Blocks if all of the stream's buffers are still in use. Filling the
+    /// buffer and passing it to submitFrame() avoids allocating and copying
+    /// a new image for every frame.
+    /// @return The buffer or nullptr if the stream has not been initialised.
+    FramePool::BufferPtr acquireFrame(const std::string& name = "render_preview") {
+        const auto stream = findStream(name);
+        const auto frames = stream ? stream->frames : nullptr;
+        if (!frames) {
+            BOOST_LOG_TRIVIAL(warning) << "Video stream '" << name << "' has not been initialised.";
+            return nullptr;
+        }
+        // Must not hold the lock while waiting for a buffer to be returned:
+        return frames->acquire();
+    }
+
+    /// Encode and send a frame obtained from acquireFrame(). The buffer can be
+    /// released as soon as this returns but must not be written to again: if
+    /// the frame is throttled the server keeps a reference to it until it is
+    /// sent (acquire a new buffer for the next frame instead).
+    void submitFrame(const FramePool::BufferPtr& frame, const std::string& name = "render_preview") {
+        TRACE_SCOPE("InterfaceServer::submitFrame");
+        if (frame) {
+            encodeFrame(frame->mat(), colour::Layout::BGR, tonemap::DisplaySettings(), name, frame);
         }
     }
 
+    /// Send a linear HDR image (32-bit float BGR of the stream's size, other
+    /// sizes are dropped with an error). On "log" streams it is log encoded
+    /// and the client applies exposure and tone mapping. Other streams are
+    /// tone mapped here with default settings.
+    void sendHdrImage(const cv::Mat& linear, const std::string& name = "render_preview") {
+        TRACE_SCOPE("InterfaceServer::sendHdrImage");
+        if (linear.type() != CV_32FC3) {
+            throw std::invalid_argument("HDR images must be 32-bit float BGR.");
+        }
+        if (!isStreamVisible(name)) {
+            return;
+        }
+        auto frame = acquireFrame(name);
+        if (!frame) {
+            return;
+        }
+        cv::Mat encoded = frame->mat();
+        if (linear.rows != encoded.rows || linear.cols != encoded.cols) {
+            // Otherwise the log encode would reallocate instead of filling the frame:
+            BOOST_LOG_TRIVIAL(error) << "HDR image size " << linear.cols << "x" << linear.rows
+                                     << " does not match video stream '" << name << "' ("
+                                     << encoded.cols << "x" << encoded.rows << ").";
+            framesFailed.add();
+            return;
+        }
+        {
+            auto streamPtr = findStream(name);
+            if (!streamPtr) {
+                return;
+            }
+            auto& stream = *streamPtr;
+            std::lock_guard<std::mutex> lock(stream.encodeMutex);
+            const auto& info = stream.info;
+            tonemap::encodeLog(linear, encoded, stream.hdrScratch, info.logMinStop, info.logMaxStop);
+            if (info.transfer != "log") {
+                if (stream.displayLut.empty()) {
+                    stream.displayLut = tonemap::makeDisplayLut(tonemap::DisplaySettings(), info.logMinStop, info.logMaxStop, 3);
+                }
+                cv::LUT(encoded, stream.displayLut, encoded);
+            }
+        }
+        submitFrame(frame, name);
+    }
+
+    /// By default video for a client on the same host goes through shared
+    /// memory (unencoded). Call before start() to always encode it.
+    void allowSharedMemory(bool allow) {
+        sharedMemoryAllowed = allow;
+    }
+
+    /// True if the connected client receives video through shared memory.
+    bool usingSharedMemory() const {
+        return clientSharedMemory;
+    }
+
+    /// Skip encoding frames that have not changed noticeably since the last
+    /// frame sent and reduce the frame rate when only small areas change.
+    /// Applies to all streams. Call before sending any frames.
+    void enableDamageTracking(const DamageTracker::Settings& settings = DamageTracker::Settings()) {
+        std::lock_guard<std::mutex> lock(streamsMutex);
+        damageSettings = settings;
+        damageTracking = true;
+    }
+
+    /// @return false if the client has hidden the named stream (frames sent to it are dropped).
+    bool isStreamVisible(const std::string& name = "render_preview") const {
+        std::lock_guard<std::mutex> lock(streamsMutex);
+        auto itr = streamVisibility.find(name);
+        return itr == streamVisibility.end() || itr->second;
+    }
+
     void stop() {
         serverReady = false;
         if (thread != nullptr) {
@@ -180,6 +613,8 @@ public:
             thread->join();
             thread.reset();
             BOOST_LOG_TRIVIAL(trace) << "Server thread joined successfuly";
+            videoSender.reset();
+            videoConnection.reset();
             sender.reset();
         } catch (std::system_error& e) {
             BOOST_LOG_TRIVIAL(error) << "User interface server thread could not be joined.";
@@ -193,26 +628,358 @@ public:
         }
     }
 
-    void sendImage(const cv::Mat& ldrImage) {
-        VideoFrame frame(ldrImage.data, AV_PIX_FMT_BGR24, ldrImage.cols, ldrImage.rows, ldrImage.step);
-        bool ok = videoStream->PutVideoFrame(frame);
-        if (!ok) {
-            BOOST_LOG_TRIVIAL(warning) << "Could not send video frame.";
+    /// Report load progress of the selected asset in the range [0, 1] (or
+    /// why it failed to load if error is not empty).
+    void updateAssetStatus(const std::string& path, float progress, const std::string& error = std::string()) {
+        if (sender) {
+            serialise(*sender, "nif_status", packets::AssetStatus{path, progress, error});
         }
     }
 
+    /// Report progressive accumulation to the client. Throughput is measured
+    /// between successive calls so this should be called once per render pass.
+    /// If the accumulated count decreases the render is assumed to have restarted.
+    void updateSampleStats(std::uint64_t accumulatedSamples, std::uint64_t targetSamples) {
+        const auto now = std::chrono::steady_clock::now();
+        const bool firstUpdate = lastSampleStatsTime == std::chrono::steady_clock::time_point();
+        if (firstUpdate || accumulatedSamples < sampleStats.accumulated) {
+            // First update or render restarted so there is no valid rate estimate:
+            sampleStats.samplesPerSecond = 0.f;
+        } else if (accumulatedSamples > sampleStats.accumulated) {
+            const double seconds = std::chrono::duration<double>(now - lastSampleStatsTime).count();
+            if (seconds > 0.0) {
+                const float rate = (accumulatedSamples - sampleStats.accumulated) / seconds;
+                sampleStats.samplesPerSecond = sampleStats.samplesPerSecond > 0.f
+                    ? 0.9f * sampleStats.samplesPerSecond + 0.1f * rate
+                    : rate;
+            }
+        }
+        lastSampleStatsTime = now;
+        sampleStats.accumulated = accumulatedSamples;
+        sampleStats.target = targetSamples;
+
+        if (accumulatedSamples >= targetSamples) {
+            sampleStats.secondsToConverge = 0.f;
+        } else if (sampleStats.samplesPerSecond > 0.f) {
+            sampleStats.secondsToConverge = (targetSamples - accumulatedSamples) / sampleStats.samplesPerSecond;
+        } else {
+            sampleStats.secondsToConverge = -1.f;
+        }
+
+        if (sender) {
+            serialise(*sender, "sample_stats", sampleStats);
+        }
+    }
+
+    /// Encode and send an image on the named video stream. Images sent to
+    /// streams the client has hidden are dropped without being encoded.
+    void sendImage(const cv::Mat& ldrImage, const std::string& name = "render_preview") {
+        TRACE_SCOPE("InterfaceServer::sendImage");
+        encodeFrame(ldrImage, colour::Layout::BGR, tonemap::DisplaySettings(), name);
+    }
+
+    /// Send an image in the renderer's own layout without converting it
+    /// first: the encoder converts it (in parallel) straight into the format
+    /// it needs. Half float layouts hold linear light and are tone mapped
+    /// with toneMapping during the conversion (on "log" streams they are
+    /// passed to sendHdrImage() instead). Damage tracking only applies to
+    /// sendImage().
+    void sendNativeImage(const cv::Mat& image, colour::Layout layout, const std::string& name = "render_preview",
+                         const tonemap::DisplaySettings& toneMapping = tonemap::DisplaySettings()) {
+        TRACE_SCOPE("InterfaceServer::sendNativeImage");
+        if (colour::isHalf(layout)) {
+            auto stream = findStream(name);
+            if (stream && stream->info.transfer == "log") {
+                cv::Mat linear, bgr;
+                image.convertTo(linear, CV_32F);
+                cv::cvtColor(linear, bgr, layout == colour::Layout::HalfRGB ? cv::COLOR_RGB2BGR : cv::COLOR_RGBA2BGR);
+                sendHdrImage(bgr, name);
+                return;
+            }
+        }
+        encodeFrame(image, layout, toneMapping, name);
+    }
+
+    /// Start or stop recording trace events (see writeTrace()).
+    static void setTracing(bool enable) {
+        trace::setEnabled(enable);
+    }
+
+    /// Write the trace events recorded so far as a Chrome trace JSON file.
+    /// @return The number of events written or -1 on error.
+    static long writeTrace(const std::string& fileName) {
+        return trace::writeChromeJson(fileName, "interface_server");
+    }
+
     virtual ~InterfaceServer() {
         stop();
     }
 
 private:
+    struct VideoStream;
+
+    /// Choose the connection for a packet type (video has its own if the client connected one).
+    PacketMuxer& senderFor(const std::string& packetType) {
+        if (videoSender && packets::isVideoPacket(packetType)) {
+            return *videoSender;
+        }
+        return *sender;
+    }
+
+    /// The named stream (or nullptr if it has not been initialised).
+    std::shared_ptr<VideoStream> findStream(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(streamsMutex);
+        auto stream = videoStreams.find(name);
+        return stream != videoStreams.end() ? stream->second : nullptr;
+    }
+
+    /// Encode and send an image unless the client has hidden the stream (or
+    /// damage tracking drops it). streamsMutex is only held to look the
+    /// stream up so that streams are encoded concurrently and the comms
+    /// thread is never blocked by an encode.
+    /// @param pooled The pool buffer that holds fullImage (if any) so a
+    /// throttled frame can be kept without copying it.
+    void encodeFrame(const cv::Mat& fullImage, colour::Layout layout, const tonemap::DisplaySettings& toneMapping,
+                     const std::string& name, const FramePool::BufferPtr& pooled = nullptr) {
+        std::shared_ptr<VideoStream> streamPtr;
+        bool trackDamage = false;
+        DamageTracker::Settings trackerSettings;
+        {
+            std::lock_guard<std::mutex> lock(streamsMutex);
+            auto visible = streamVisibility.find(name);
+            if (visible != streamVisibility.end() && !visible->second) {
+                return;
+            }
+            auto itr = videoStreams.find(name);
+            if (itr != videoStreams.end()) {
+                streamPtr = itr->second;
+            }
+            trackDamage = damageTracking;
+            trackerSettings = damageSettings;
+        }
+        if (!streamPtr) {
+            BOOST_LOG_TRIVIAL(warning) << "Video stream '" << name << "' has not been initialised.";
+            return;
+        }
+        auto& stream = *streamPtr;
+        std::lock_guard<std::mutex> lock(stream.encodeMutex);
+        if (!stream.encoder) {
+            return; // The client disconnected.
+        }
+        // Full size frames are cropped to the band this server renders (a view, not a copy):
+        const auto& band = stream.band;
+        const cv::Mat image = fullImage.rows > band.size() ? fullImage.rowRange(band) : fullImage;
+        if (trackDamage && layout == colour::Layout::BGR) {
+            auto& tracker = stream.damage;
+            if (!tracker) {
+                tracker.reset(new DamageTracker(trackerSettings));
+            }
+            const auto decision = tracker->decide(image, std::chrono::steady_clock::now());
+            damagedFraction.set(tracker->lastDamagedFraction());
+            if (decision == DamageTracker::Decision::Skip) {
+                // The client's image already matches this frame so a throttled one is stale:
+                dropThrottled(stream);
+                framesSkipped.add();
+                return;
+            }
+            if (decision == DamageTracker::Decision::Throttle) {
+                // Keep the frame so it is still sent when the interval expires
+                // if no newer frame arrives (see throttledFrameLoop()). A pool
+                // buffer is held rather than copied (the renderer has finished
+                // with it) but other images belong to the caller:
+                if (pooled) {
+                    stream.throttledBuffer = pooled;
+                    stream.throttled = image;
+                } else {
+                    stream.throttledBuffer.reset();
+                    image.copyTo(stream.throttledCopy);
+                    stream.throttled = stream.throttledCopy;
+                }
+                stream.hasThrottled = true;
+                stream.throttledValue = renderedValue;
+                stream.throttledFrameId = frameId;
+                framesThrottled.add();
+                scheduleThrottled(tracker->throttledUntil());
+                return;
+            }
+            // The latest frame supersedes any throttled one:
+            dropThrottled(stream);
+        }
+        const auto& lut = colour::isHalf(layout) ? toneLutFor(stream, toneMapping) : colour::defaultToneLut();
+        sendFrame(stream, name, image, layout, lut, renderedValue, frameId);
+    }
+
+    /// Release a throttled frame (returning its buffer to the pool). Must be
+    /// called with the stream's encodeMutex held.
+    void dropThrottled(VideoStream& stream) {
+        stream.hasThrottled = false;
+        stream.throttled.release();
+        stream.throttledBuffer.reset();
+    }
+
+    /// Wake the throttle thread by the time a throttled frame can be sent.
+    void scheduleThrottled(std::chrono::steady_clock::time_point due) {
+        {
+            std::lock_guard<std::mutex> lock(throttleMutex);
+            if (due >= nextThrottled) {
+                return;
+            }
+            nextThrottled = due;
+        }
+        throttleDue.notify_one();
+    }
+
+    /// Runs on its own thread while a client is connected: sends throttled
+    /// frames once their rate limit expires (if no newer frame replaced them).
+    void throttledFrameLoop() {
+        trace::setThreadName("throttled_frames");
+        const auto never = std::chrono::steady_clock::time_point::max();
+        std::unique_lock<std::mutex> lock(throttleMutex);
+        while (throttleRunning) {
+            if (nextThrottled == never) {
+                throttleDue.wait(lock);
+            } else {
+                throttleDue.wait_until(lock, nextThrottled);
+            }
+            if (!throttleRunning || std::chrono::steady_clock::now() < nextThrottled) {
+                continue;
+            }
+            nextThrottled = never;
+            lock.unlock();
+            flushThrottledFrames();
+            lock.lock();
+        }
+    }
+
+    /// Send any throttled frames whose rate limit has expired (and schedule the rest).
+    void flushThrottledFrames() {
+        std::vector<std::pair<std::string, std::shared_ptr<VideoStream>>> streams;
+        {
+            std::lock_guard<std::mutex> lock(streamsMutex);
+            streams.assign(videoStreams.begin(), videoStreams.end());
+        }
+        for (auto& entry : streams) {
+            auto& stream = *entry.second;
+            std::lock_guard<std::mutex> lock(stream.encodeMutex);
+            if (!stream.hasThrottled || !stream.encoder || !stream.damage) {
+                continue;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now < stream.damage->throttledUntil()) {
+                scheduleThrottled(stream.damage->throttledUntil());
+                continue;
+            }
+            stream.damage->sendThrottled(stream.throttled, now);
+            sendFrame(stream, entry.first, stream.throttled, colour::Layout::BGR, colour::defaultToneLut(),
+                      stream.throttledValue, stream.throttledFrameId);
+            dropThrottled(stream);
+        }
+    }
+
+    /// Encode the image and send its frame info. Must be called with the stream's encodeMutex held.
+    /// @param id Frame ID set by setFrameId() (or -1 to use the stream's own count).
+    void sendFrame(VideoStream& stream, const std::string& name, const cv::Mat& image, colour::Layout layout,
+                   const colour::ToneLut& lut, float value, std::int64_t id) {
+        const auto sendTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        const std::uint64_t frameId = id >= 0 ? std::uint64_t(id) : stream.nextFrameId++;
+        bool ok = false;
+        {
+            metrics::ScopedTimer timer(encodeTime);
+            stream.encoder->setFrameId(frameId);
+            ok = stream.encoder->putNativeFrame(image, layout, lut);
+        }
+        if (ok) {
+            framesEncoded.add();
+            // Tell the client which control value the frame was rendered with
+            // so it can reproject the image while newer input is in flight (and
+            // when it was sent so the client can pace playback). The client
+            // pairs infos with frames in order so a frame that failed to
+            // encode must not have one:
+            if (sender) {
+                serialise(senderFor("frame_info"), "frame_info", packets::FrameInfo{name, frameId, value, sendTimeUs});
+            }
+        } else {
+            framesFailed.add();
+            BOOST_LOG_TRIVIAL(warning) << "Could not send video frame.";
+        }
+    }
+
+    /// The stream's tone mapping table for settings (rebuilt only when the
+    /// settings change). Must be called with the stream's encodeMutex held.
+    const colour::ToneLut& toneLutFor(VideoStream& stream, const tonemap::DisplaySettings& settings) {
+        auto& lut = stream.toneLut;
+        if (!lut || !lut->matches(settings)) {
+            lut = std::make_unique<colour::ToneLut>(settings);
+        }
+        return *lut;
+    }
+
     int port;
+    std::string sessionFile;
     TcpSocket serverSocket;
     std::unique_ptr<std::thread> thread;
     std::atomic<bool> serverReady;
     std::atomic<bool> stateUpdated;
+    std::atomic<float> renderedValue; // State value at the last consumeState().
+    std::atomic<std::int64_t> frameId{-1}; // Set by setFrameId() (-1 to number each stream's frames).
+    packets::TileAssignment tile; // Written by the comms thread before serverReady is set.
+    bool sharedMemoryAllowed = true;
+    std::atomic<bool> clientSharedMemory{false};
     std::unique_ptr<TcpSocket> connection;
     std::unique_ptr<PacketMuxer> sender;
-    std::unique_ptr<LibAvWriter> videoStream;
+    int videoPort = 0;
+    TcpSocket videoServerSocket;
+    std::unique_ptr<TcpSocket> videoConnection;
+    std::unique_ptr<PacketMuxer> videoSender; // Only used if a separate video channel is enabled.
+    std::unique_ptr<AsyncFileWriter> sessionRecorder;
+    ThumbnailService thumbnails;
+
+    /// The encoder state is protected by encodeMutex. The other members
+    /// are fixed once the stream is in videoStreams.
+    struct VideoStream {
+        std::mutex encodeMutex;
+        std::unique_ptr<VideoEncoder> encoder;
+        std::unique_ptr<DamageTracker> damage;
+        cv::Mat throttled; // Last frame held back by the damage tracker (if hasThrottled).
+        FramePool::BufferPtr throttledBuffer; // Pool buffer that throttled views (if it came from the pool).
+        cv::Mat throttledCopy; // Reused for throttled frames that did not come from the pool.
+        bool hasThrottled = false;
+        float throttledValue = 0.f;
+        std::int64_t throttledFrameId = -1;
+        std::shared_ptr<FramePool> frames;
+        std::uint64_t nextFrameId = 0;
+        cv::Range band; // Rows of the full frame that are encoded (see tileAssignment()).
+        packets::StreamInfo info; // Includes the transfer function and stop range used by sendHdrImage().
+        cv::Mat hdrScratch;
+        cv::Mat displayLut;
+        std::unique_ptr<colour::ToneLut> toneLut; // Used by sendNativeImage().
+    };
+    bool damageTracking = false;
+    DamageTracker::Settings damageSettings;
+    std::map<std::string, std::shared_ptr<VideoStream>> videoStreams;
+    std::map<std::string, bool> streamVisibility;
+    mutable std::mutex streamsMutex; // Protects videoStreams and streamVisibility.
+    std::mutex throttleMutex; // Protects nextThrottled and throttleRunning.
+    std::condition_variable throttleDue;
+    std::chrono::steady_clock::time_point nextThrottled = std::chrono::steady_clock::time_point::max();
+    bool throttleRunning = false;
     State state;
+    mutable std::mutex stateMutex; // Protects state.
+    packets::SampleStats sampleStats;
+    std::chrono::steady_clock::time_point lastSampleStatsTime;
+
+    // Streaming health metrics (updated with relaxed atomics only):
+    metrics::Counter& framesEncoded;
+    metrics::Counter& framesSkipped;
+    metrics::Counter& framesThrottled;
+    metrics::Gauge& damagedFraction;
+    metrics::Counter& framesFailed;
+    metrics::Counter& videoPacketsSent;
+    metrics::Counter& videoBytesSent;
+    metrics::Counter& stateUpdates;
+    metrics::Gauge& connectedClients;
+    metrics::Histogram& encodeTime;
+    metrics::Histogram& muxerEnqueueTime;
+    std::unique_ptr<MetricsEndpoint> metricsEndpoint;
 };
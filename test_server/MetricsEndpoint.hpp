@@ -0,0 +1,110 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <network/TcpSocket.h>
+#include <Metrics.hpp>
+
+#include <boost/log/trivial.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/// Minimal HTTP endpoint that serves the contents of a metrics registry in
+/// the Prometheus text format (e.g. 'curl http://localhost:<port>/metrics').
+/// Every request gets the same response regardless of path. Connections are
+/// served one at a time on a dedicated thread so scraping never touches the
+/// streaming threads (metrics are only ever read with relaxed atomics).
+/// A client that connects but does not send a request is dropped after a
+/// timeout so it can not stall the endpoint.
+class MetricsEndpoint {
+public:
+    MetricsEndpoint(metrics::Registry& metricsRegistry, int portNumber, const std::string& namePrefix)
+        : registry(metricsRegistry),
+          port(portNumber),
+          prefix(namePrefix),
+          running(true),
+          listening(false),
+          thread(&MetricsEndpoint::serve, this) {
+        while (!listening) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    virtual ~MetricsEndpoint() {
+        running = false;
+        // Accept() blocks so make a connection to wake the thread up:
+        TcpSocket wakeUp;
+        wakeUp.Connect("localhost", port);
+        thread.join();
+    }
+
+private:
+    void serve() {
+        bool ok = serverSocket.Bind(port);
+        if (ok) {
+            ok = serverSocket.Listen(4);
+        }
+        listening = true;
+        if (!ok) {
+            BOOST_LOG_TRIVIAL(error) << "Metrics endpoint could not listen on port " << port;
+            return;
+        }
+        BOOST_LOG_TRIVIAL(info) << "Serving metrics on port " << port;
+
+        while (running) {
+            auto connection = serverSocket.Accept();
+            if (!running) {
+                break;
+            }
+            if (!connection) {
+                BOOST_LOG_TRIVIAL(warning) << "Metrics endpoint failed to accept a connection.";
+                continue;
+            }
+
+            // The request itself is ignored but it has to be consumed or
+            // closing the connection could reset it before the client reads.
+            // Poll for it so that a silent client can not block the loop:
+            connection->setBlocking(false);
+            const auto deadline = std::chrono::steady_clock::now() + requestTimeout;
+            char request[4096];
+            bool gotRequest = false;
+            while (running && !gotRequest && std::chrono::steady_clock::now() < deadline) {
+                gotRequest = connection->Read(request, sizeof(request)) > 0;
+                if (!gotRequest) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            if (!gotRequest) {
+                BOOST_LOG_TRIVIAL(debug) << "Metrics endpoint dropped a connection that sent no request.";
+                continue;
+            }
+            connection->setBlocking(true);
+
+            std::ostringstream body;
+            registry.writePrometheus(body, prefix);
+            const std::string content = body.str();
+            std::ostringstream response;
+            response << "HTTP/1.0 200 OK\r\n"
+                     << "Content-Type: text/plain; version=0.0.4\r\n"
+                     << "Content-Length: " << content.size() << "\r\n"
+                     << "Connection: close\r\n\r\n"
+                     << content;
+            const std::string data = response.str();
+            connection->Write(data.data(), data.size());
+        }
+    }
+
+    static constexpr std::chrono::milliseconds requestTimeout{1000};
+
+    metrics::Registry& registry;
+    const int port;
+    const std::string prefix;
+    std::atomic<bool> running;
+    std::atomic<bool> listening;
+    TcpSocket serverSocket;
+    std::thread thread;
+};
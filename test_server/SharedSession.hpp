@@ -0,0 +1,393 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <SharedFrameRing.hpp>
+
+#include "InterfaceServer.hpp"
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Lets a renderer hand its frames to a separate streaming process (the
+/// test server's --daemon mode) so that encoding and comms can not compete
+/// with, or crash, the render. The renderer uses FrameProducer, which has
+/// the same frame and state methods as InterfaceServer, and the daemon uses
+/// SessionFeed to serve them with an InterfaceServer.
+///
+/// A session is a control block in named shared memory plus a
+/// SharedFrameRing per video stream. The renderer owns them all so the
+/// daemon can be stopped and restarted while the render carries on. Each
+/// direction has a single writer and values are published with sequence
+/// locks, so neither process can block the other.
+namespace session {
+
+const std::uint32_t magic = 0x53534553; // "SESS"
+const std::size_t maxStreams = 4;
+
+// A process whose heartbeat is older than this has stopped or crashed:
+const std::int64_t heartbeatTimeoutMs = 1000;
+const std::int64_t heartbeatIntervalMs = 100;
+
+inline std::string controlName(const std::string& session) { return "/remote_ui_session_" + session; }
+inline std::string ringName(const std::string& session, const std::string& stream) {
+    return controlName(session) + "_" + stream;
+}
+
+/// Copy a string into a fixed size field (truncating it if necessary).
+template <std::size_t N>
+void copyString(char (&field)[N], const std::string& value) {
+    const std::size_t size = std::min(value.size(), N - 1);
+    std::memcpy(field, value.data(), size);
+    field[size] = '\0';
+}
+
+/// A value with a single writer published under a sequence lock.
+template <class T>
+struct Published {
+    std::atomic<std::uint64_t> version;
+    T value;
+
+    void store(const T& newValue) {
+        const std::uint64_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&value, &newValue, sizeof(T));
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    /// @return The version read (0 if nothing has been published yet or the
+    /// writer stalled part way through an update).
+    std::uint64_t load(T& result) const {
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            const std::uint64_t v = version.load(std::memory_order_acquire);
+            if (v & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::memcpy(&result, &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (version.load(std::memory_order_relaxed) == v) {
+                return v;
+            }
+        }
+        return 0;
+    }
+};
+
+struct StreamDescriptor {
+    char name[64];
+    char codec[16];
+    char transfer[16];
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t fps;
+};
+
+/// Control state sent by the client (written by the daemon).
+struct RenderState {
+    float value;
+    std::uint32_t samples;
+    std::uint32_t stop;
+    char nifPath[1024];
+};
+
+/// Progress reported by the renderer (written by the producer).
+struct RenderStatus {
+    std::int32_t progressStep;
+    std::int32_t progressTotal;
+    std::uint64_t accumulatedSamples;
+    std::uint64_t targetSamples;
+};
+
+struct ControlBlock {
+    std::uint32_t magic;
+    std::atomic<std::uint32_t> producerAlive;
+    std::atomic<std::uint32_t> streamCount;
+    StreamDescriptor streams[maxStreams];
+    Published<RenderStatus> status;
+    Published<RenderState> state;
+    std::atomic<std::int64_t> daemonHeartbeatMs; // Steady clock time of the daemon's last loop.
+    std::atomic<std::int64_t> producerHeartbeatMs; // Updated by the producer's heartbeat thread.
+};
+
+static_assert(std::atomic<std::int64_t>::is_always_lock_free, "Shared memory atomics must be lock free.");
+
+inline std::int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The mapped control block (created by the producer, opened by the daemon).
+class ControlMapping {
+public:
+    ControlMapping(const std::string& name, bool create) : memoryName(name), owner(create) {
+        namespace ipc = boost::interprocess;
+        if (create) {
+            ipc::shared_memory_object::remove(name.c_str());
+            ipc::shared_memory_object memory(ipc::create_only, name.c_str(), ipc::read_write);
+            memory.truncate(sizeof(ControlBlock));
+            region = ipc::mapped_region(memory, ipc::read_write);
+            block = new (region.get_address()) ControlBlock();
+            block->magic = magic;
+        } else {
+            ipc::shared_memory_object memory(ipc::open_only, name.c_str(), ipc::read_write);
+            region = ipc::mapped_region(memory, ipc::read_write);
+            block = static_cast<ControlBlock*>(region.get_address());
+            if (region.get_size() < sizeof(ControlBlock) || block->magic != magic) {
+                throw std::runtime_error("Shared memory '" + name + "' is not a streaming session.");
+            }
+        }
+    }
+
+    ~ControlMapping() {
+        if (owner) {
+            boost::interprocess::shared_memory_object::remove(memoryName.c_str());
+        }
+    }
+
+    ControlBlock* operator->() { return block; }
+    const ControlBlock* operator->() const { return block; }
+
+private:
+    std::string memoryName;
+    bool owner;
+    boost::interprocess::mapped_region region;
+    ControlBlock* block;
+};
+
+} // end namespace session
+
+/// Renderer side of a session: write frames and read the client's control
+/// state without running any comms or encoding in the renderer's process.
+class FrameProducer {
+public:
+    FrameProducer(const std::string& sessionName)
+        : name(sessionName),
+          control(session::controlName(sessionName), true),
+          consumedVersion(0),
+          renderedValue(InterfaceServer::State().value),
+          running(true) {
+        control->producerHeartbeatMs = session::nowMs();
+        control->producerAlive = 1;
+        // The render loop can stall for much longer than the timeout so the
+        // heartbeat has its own thread (which dies with the process):
+        heartbeatThread = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(heartbeatMutex);
+            while (running) {
+                control->producerHeartbeatMs = session::nowMs();
+                stopHeartbeat.wait_for(lock, std::chrono::milliseconds(session::heartbeatIntervalMs));
+            }
+        });
+    }
+
+    virtual ~FrameProducer() {
+        {
+            std::lock_guard<std::mutex> lock(heartbeatMutex);
+            running = false;
+        }
+        stopHeartbeat.notify_all();
+        heartbeatThread.join();
+        control->producerAlive = 0;
+    }
+
+    /// Create a stream's frame ring and announce it to the daemon. The
+    /// arguments are passed to InterfaceServer::initialiseVideoStream().
+    void initialiseVideoStream(std::size_t width, std::size_t height, const std::string& stream = "render_preview", int fps = 30,
+                               const std::string& codec = "libav", const std::string& transfer = "srgb") {
+        const std::uint32_t index = control->streamCount;
+        if (index >= session::maxStreams || rings.count(stream)) {
+            throw std::runtime_error("Can not add video stream '" + stream + "' to the session.");
+        }
+        // The daemon would refuse the stream (see InterfaceServer::initialiseVideoStream()):
+        if (codec == "libav" && (width % 2 || height % 2)) {
+            throw std::runtime_error("Video stream '" + stream + "' must have an even width and height.");
+        }
+        rings[stream] = std::make_unique<SharedFrameRing>(
+            SharedFrameRing::create(session::ringName(name, stream), int(width), int(height)));
+        auto& descriptor = control->streams[index];
+        session::copyString(descriptor.name, stream);
+        session::copyString(descriptor.codec, codec);
+        session::copyString(descriptor.transfer, transfer);
+        descriptor.width = width;
+        descriptor.height = height;
+        descriptor.fps = fps;
+        control->streamCount.store(index + 1, std::memory_order_release);
+    }
+
+    /// Publish an 8-bit BGR image. Never blocks (if the daemon is slow or
+    /// not running old frames are overwritten).
+    void sendImage(const cv::Mat& bgrImage, const std::string& stream = "render_preview") {
+        auto ring = rings.find(stream);
+        if (ring == rings.end()) {
+            throw std::runtime_error("Video stream '" + stream + "' has not been initialised.");
+        }
+        if (bgrImage.cols != ring->second->width() || bgrImage.rows != ring->second->height() || bgrImage.type() != CV_8UC3) {
+            throw std::runtime_error("Image does not match the format of video stream '" + stream + "'.");
+        }
+        ring->second->write(bgrImage.ptr<std::uint8_t>(), bgrImage.step, renderedValue);
+    }
+
+    /// Has the client changed the state since it was last consumed?
+    bool stateChanged() const {
+        session::RenderState state;
+        const auto version = control->state.load(state);
+        return version != 0 && version != consumedVersion;
+    }
+
+    InterfaceServer::State getState() const {
+        session::RenderState shared;
+        return toState(shared, control->state.load(shared));
+    }
+
+    /// Return a copy of the state and mark it as consumed.
+    InterfaceServer::State consumeState() {
+        // The state must come from the same read as the version it is marked with:
+        session::RenderState shared;
+        consumedVersion = control->state.load(shared);
+        auto state = toState(shared, consumedVersion);
+        renderedValue = state.value; // Frames sent from now on are tagged with this value.
+        return state;
+    }
+
+    void updateProgress(int step, int totalSteps) {
+        status.progressStep = step;
+        status.progressTotal = totalSteps;
+        control->status.store(status);
+    }
+
+    void updateSampleStats(std::uint64_t accumulatedSamples, std::uint64_t targetSamples) {
+        status.accumulatedSamples = accumulatedSamples;
+        status.targetSamples = targetSamples;
+        control->status.store(status);
+    }
+
+    /// True if a daemon is serving the session.
+    bool daemonConnected() const {
+        return session::nowMs() - control->daemonHeartbeatMs.load() < session::heartbeatTimeoutMs;
+    }
+
+private:
+    /// The state read with version (the defaults if the read failed).
+    static InterfaceServer::State toState(const session::RenderState& shared, std::uint64_t version) {
+        InterfaceServer::State state;
+        if (version != 0) {
+            state.value = shared.value;
+            state.samples = shared.samples;
+            state.stop = shared.stop != 0;
+            state.nifPath = shared.nifPath;
+        }
+        return state;
+    }
+
+    std::string name;
+    session::ControlMapping control;
+    std::map<std::string, std::unique_ptr<SharedFrameRing>> rings;
+    std::uint64_t consumedVersion;
+    float renderedValue;
+    session::RenderStatus status{0, 1, 0, 0};
+    bool running; // Protected by heartbeatMutex.
+    std::mutex heartbeatMutex;
+    std::condition_variable stopHeartbeat;
+    std::thread heartbeatThread;
+};
+
+/// Daemon side of a session: read the renderer's frames and status and
+/// publish the client's control state back to it.
+class SessionFeed {
+public:
+    /// Throws if the renderer has not created the session.
+    SessionFeed(const std::string& sessionName)
+        : name(sessionName),
+          control(session::controlName(sessionName), false),
+          statusVersion(0) {}
+
+    /// False once the renderer has closed the session or its heartbeat stops
+    /// (e.g. it crashed).
+    bool producerAlive() const {
+        return control->producerAlive != 0 &&
+               session::nowMs() - control->producerHeartbeatMs.load() < session::heartbeatTimeoutMs;
+    }
+
+    /// Let the producer know the daemon is running (call regularly).
+    void heartbeat() { control->daemonHeartbeatMs = session::nowMs(); }
+
+    std::vector<session::StreamDescriptor> streams() const {
+        const std::uint32_t count = std::min<std::uint32_t>(control->streamCount.load(std::memory_order_acquire), session::maxStreams);
+        return std::vector<session::StreamDescriptor>(control->streams, control->streams + count);
+    }
+
+    /// Copy the newest frame of the stream into target if it has not been
+    /// read before. value is set to the control value the frame was tagged with.
+    bool readNewFrame(const std::string& stream, cv::Mat& target, float& value) {
+        auto& reader = readers[stream];
+        if (!reader.ring) {
+            reader.ring = std::make_unique<SharedFrameRing>(SharedFrameRing::open(session::ringName(name, stream)));
+        }
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            const auto token = reader.ring->latest();
+            if (token.sequence == 0 || token.sequence == reader.lastSequence) {
+                return false;
+            }
+            double tag = 0.0;
+            const std::size_t rowBytes = std::size_t(target.cols) * target.elemSize();
+            const bool ok = reader.ring->read(token, [&](const std::uint8_t* pixels, std::size_t step) {
+                for (int y = 0; y < target.rows; ++y) {
+                    std::memcpy(target.ptr<std::uint8_t>(y), pixels + y * step, rowBytes);
+                }
+            }, &tag);
+            if (ok) {
+                reader.lastSequence = token.sequence;
+                value = float(tag);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void publishState(const InterfaceServer::State& state) {
+        session::RenderState shared;
+        shared.value = state.value;
+        shared.samples = state.samples;
+        shared.stop = state.stop;
+        session::copyString(shared.nifPath, state.nifPath);
+        control->state.store(shared);
+    }
+
+    /// @return true if the renderer has reported new status since the last call.
+    bool readStatus(session::RenderStatus& status) {
+        const auto version = control->status.load(status);
+        if (version == 0 || version == statusVersion) {
+            return false;
+        }
+        statusVersion = version;
+        return true;
+    }
+
+private:
+    struct Reader {
+        std::unique_ptr<SharedFrameRing> ring;
+        std::uint64_t lastSequence = 0;
+    };
+
+    std::string name;
+    session::ControlMapping control;
+    std::map<std::string, Reader> readers;
+    std::uint64_t statusVersion;
+};
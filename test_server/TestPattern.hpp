@@ -0,0 +1,162 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Generates synthetic BGR frames to load the encoder and network in
+/// different ways. Rows are generated in parallel and the inner loops are
+/// free of divisions so that they vectorise (fast enough for 4K at 60fps).
+///
+/// Profiles:
+///  - static: the same gradient every frame (the encoder only sends skips).
+///  - scrolling: a gradient that scrolls one pixel per frame (motion everywhere).
+///  - noise: new random pixels every frame (worst case for the encoder).
+///  - regions: a static gradient with a few small noisy squares moving over it.
+class TestPattern {
+public:
+    enum class Profile { Static, Scrolling, Noise, Regions };
+
+    static Profile parseProfile(const std::string& name) {
+        if (name == "static") { return Profile::Static; }
+        if (name == "scrolling") { return Profile::Scrolling; }
+        if (name == "noise") { return Profile::Noise; }
+        if (name == "regions") { return Profile::Regions; }
+        throw std::runtime_error("Unknown test pattern profile: '" + name + "'");
+    }
+
+    TestPattern(Profile patternProfile, int width, int height)
+        : profile(patternProfile),
+          gradient(2 * width),
+          lastTint(-1) {
+        // Two periods of the horizontal gradient so that any scroll offset
+        // can be read as one contiguous row:
+        for (int x = 0; x < 2 * width; ++x) {
+            gradient[x] = (x % width) % 255;
+        }
+        background.create(height, width, CV_8UC3);
+    }
+
+    /// Render the frame for frameIndex into target (which must be an 8-bit
+    /// BGR image of the pattern's size). The tint shifts the red channel and
+    /// yawShift rotates the image horizontally by that many pixels (as turning
+    /// the camera would in an equirectangular render). Noise ignores yawShift.
+    void render(std::uint64_t frameIndex, std::uint8_t tint, cv::Mat& target, int yawShift = 0) {
+        yawShift = ((yawShift % target.cols) + target.cols) % target.cols;
+        switch (profile) {
+        case Profile::Static:
+            // The pattern is only regenerated if the tint changes:
+            if (tint != lastTint) {
+                renderGradient(background, 0, tint);
+            }
+            copyRows(background, target, yawShift);
+            break;
+        case Profile::Scrolling:
+            renderGradient(target, (frameIndex + yawShift) % target.cols, tint);
+            break;
+        case Profile::Noise:
+            renderNoise(target, frameIndex);
+            break;
+        case Profile::Regions:
+            if (tint != lastTint) {
+                renderGradient(background, 0, tint);
+            }
+            copyRows(background, target, yawShift);
+            renderRegions(frameIndex, target);
+            break;
+        }
+        lastTint = tint;
+    }
+
+private:
+    /// Same pattern as the original per-pixel test image.
+    void renderGradient(cv::Mat& target, int offset, std::uint8_t tint) const {
+        const std::uint8_t* row = gradient.data() + offset;
+        const int width = target.cols;
+        cv::parallel_for_(cv::Range(0, target.rows), [&](const cv::Range& rows) {
+            for (int y = rows.start; y < rows.end; ++y) {
+                const int gy = y % 255;
+                const std::uint8_t red = (y + tint) % 255;
+                std::uint8_t* out = target.ptr<std::uint8_t>(y);
+                for (int x = 0; x < width; ++x) {
+                    const int blue = row[x];
+                    int green = blue + gy;
+                    green -= green >= 255 ? 255 : 0;
+                    out[3 * x + 0] = blue;
+                    out[3 * x + 1] = green;
+                    out[3 * x + 2] = red;
+                }
+            }
+        });
+    }
+
+    /// Fill a block of bytes with xorshift64* output (seeded per frame and row).
+    static void fillNoise(std::uint8_t* data, std::size_t size, std::uint64_t seed) {
+        std::uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+        std::size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            const std::uint64_t value = state * 0x2545F4914F6CDD1Dull;
+            std::memcpy(data + i, &value, 8);
+        }
+        for (; i < size; ++i) {
+            data[i] = std::uint8_t(state >> (8 * (i & 7)));
+        }
+    }
+
+    void renderNoise(cv::Mat& target, std::uint64_t frameIndex) const {
+        const std::size_t rowBytes = target.cols * target.elemSize();
+        cv::parallel_for_(cv::Range(0, target.rows), [&](const cv::Range& rows) {
+            for (int y = rows.start; y < rows.end; ++y) {
+                fillNoise(target.ptr<std::uint8_t>(y), rowBytes, (frameIndex << 20) + y);
+            }
+        });
+    }
+
+    /// Row by row copy (the target rows may be padded). Each row is rotated
+    /// left by shift pixels which costs two copies instead of one.
+    static void copyRows(const cv::Mat& source, cv::Mat& target, int shift) {
+        const std::size_t pixelBytes = source.elemSize();
+        const std::size_t rowBytes = source.cols * pixelBytes;
+        const std::size_t headBytes = shift * pixelBytes;
+        cv::parallel_for_(cv::Range(0, source.rows), [&](const cv::Range& rows) {
+            for (int y = rows.start; y < rows.end; ++y) {
+                const std::uint8_t* in = source.ptr<std::uint8_t>(y);
+                std::uint8_t* out = target.ptr<std::uint8_t>(y);
+                std::memcpy(out, in + headBytes, rowBytes - headBytes);
+                std::memcpy(out + rowBytes - headBytes, in, headBytes);
+            }
+        });
+    }
+
+    /// A few small squares move around on Lissajous paths.
+    static void renderRegions(std::uint64_t frameIndex, cv::Mat& image) {
+        const int regionCount = 4;
+        const int size = std::max(8, std::min(image.cols, image.rows) / 16);
+        const int rangeX = image.cols - size;
+        const int rangeY = image.rows - size;
+        for (int r = 0; r < regionCount && rangeX > 0 && rangeY > 0; ++r) {
+            const double t = frameIndex * 0.02 * (r + 1);
+            const int x = int((0.5 + 0.5 * std::sin(t + r)) * rangeX);
+            const int y = int((0.5 + 0.5 * std::cos(1.3 * t + 2 * r)) * rangeY);
+            for (int row = y; row < y + size; ++row) {
+                fillNoise(image.ptr<std::uint8_t>(row) + 3 * x, 3 * size, (frameIndex << 24) + (r << 16) + row);
+            }
+        }
+    }
+
+    const Profile profile;
+    std::vector<std::uint8_t> gradient;
+    cv::Mat background;
+    int lastTint;
+};
@@ -0,0 +1,222 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <PacketDescriptions.hpp>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+/// 64-bit FNV-1a hash of a byte buffer as a hex string.
+inline std::string contentHash(const std::vector<std::uint8_t>& bytes) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto b : bytes) {
+        hash = (hash ^ b) * 1099511628211ull;
+    }
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+/// Load each thumbnail, scale it to fit a tile and pack the tiles into a
+/// single JPEG encoded atlas. Paths that can not be loaded get a plain tile.
+/// The atlas is limited to maxAtlasSize pixels in each dimension so very
+/// large catalogues may not get thumbnails for every entry. If cancelled
+/// returns true part way through an empty atlas is returned.
+inline packets::ThumbnailAtlas buildThumbnailAtlas(const std::vector<std::string>& paths,
+                                                   int tileWidth = 128, int tileHeight = 64,
+                                                   int maxAtlasSize = 4096,
+                                                   const std::function<bool()>& cancelled = {}) {
+    packets::ThumbnailAtlas atlas;
+    const std::size_t maxColumns = maxAtlasSize / tileWidth;
+    const std::size_t maxTiles = maxColumns * (maxAtlasSize / tileHeight);
+    const std::size_t count = std::min(paths.size(), maxTiles);
+    if (count < paths.size()) {
+        BOOST_LOG_TRIVIAL(warning) << "Thumbnail atlas is full: " << paths.size() - count << " entries have no thumbnail.";
+    }
+    if (count == 0) {
+        return atlas;
+    }
+
+    const std::size_t columns = std::min(count, maxColumns);
+    const std::size_t rows = (count + columns - 1) / columns;
+    cv::Mat image(rows * tileHeight, columns * tileWidth, CV_8UC3, cv::Scalar(48, 48, 48));
+
+    std::size_t loaded = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (cancelled && cancelled()) {
+            return packets::ThumbnailAtlas();
+        }
+        if (paths[i].empty()) {
+            continue;
+        }
+        cv::Mat thumbnail = cv::imread(paths[i], cv::IMREAD_COLOR);
+        if (thumbnail.empty()) {
+            BOOST_LOG_TRIVIAL(debug) << "Could not load thumbnail: " << paths[i];
+            continue;
+        }
+
+        // Fit inside the tile preserving aspect ratio:
+        const double scale = std::min(double(tileWidth) / thumbnail.cols, double(tileHeight) / thumbnail.rows);
+        const int w = std::max(1, int(std::round(thumbnail.cols * scale)));
+        const int h = std::max(1, int(std::round(thumbnail.rows * scale)));
+        const int x = (i % columns) * tileWidth + (tileWidth - w) / 2;
+        const int y = (i / columns) * tileHeight + (tileHeight - h) / 2;
+        cv::Mat tile = image(cv::Rect(x, y, w, h));
+        cv::resize(thumbnail, tile, tile.size(), 0, 0, cv::INTER_AREA);
+        loaded += 1;
+    }
+
+    cv::imencode(".jpg", image, atlas.image);
+    atlas.hash = contentHash(atlas.image);
+    atlas.tileWidth = tileWidth;
+    atlas.tileHeight = tileHeight;
+    atlas.columns = columns;
+    atlas.count = count;
+    BOOST_LOG_TRIVIAL(info) << "Built thumbnail atlas " << atlas.hash << " with " << loaded << "/" << count
+                            << " thumbnails (" << atlas.image.size() << " bytes)";
+    return atlas;
+}
+
+/// Builds thumbnail atlases on a single worker thread so that requests never
+/// block packet handling. Only the latest request is kept: a new request
+/// replaces one that has not started yet and cancels one that is being built.
+/// Atlases are cached by their list of paths and the files' modification
+/// times so repeated requests for an unchanged catalogue (e.g. every time a
+/// client connects) are answered without loading or encoding anything.
+class ThumbnailService {
+public:
+    using Reply = std::function<void(const packets::ThumbnailAtlas&)>;
+
+    ThumbnailService()
+        : running(true),
+          cancelled(false),
+          busy(false),
+          thread(&ThumbnailService::workerLoop, this) {}
+
+    virtual ~ThumbnailService() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+            cancelled = true;
+        }
+        workAvailable.notify_all();
+        thread.join();
+    }
+
+    /// Queue a request. reply is called from the worker thread.
+    void request(const packets::ThumbnailRequest& request, Reply reply) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.reset(new Job{request, reply});
+            cancelled = busy;
+        }
+        workAvailable.notify_all();
+    }
+
+    /// Drop any queued request and wait until no reply is in progress (call
+    /// this before whatever the replies use goes away).
+    void cancel() {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.reset();
+        cancelled = true;
+        idle.wait(lock, [this]() { return !busy; });
+    }
+
+private:
+    struct Job {
+        packets::ThumbnailRequest request;
+        Reply reply;
+    };
+
+    /// Hash of the paths and the modification time of each file.
+    static std::string cacheKey(const std::vector<std::string>& paths) {
+        std::vector<std::uint8_t> bytes;
+        for (const auto& path : paths) {
+            bytes.insert(bytes.end(), path.begin(), path.end());
+            std::error_code error;
+            const auto modified = std::filesystem::last_write_time(path, error);
+            const std::int64_t ticks = error ? -1 : std::int64_t(modified.time_since_epoch().count());
+            const auto* tickBytes = reinterpret_cast<const std::uint8_t*>(&ticks);
+            bytes.insert(bytes.end(), tickBytes, tickBytes + sizeof(ticks));
+            bytes.push_back(0);
+        }
+        return contentHash(bytes);
+    }
+
+    /// Only called from the worker thread (so the cache needs no lock).
+    bool atlasFor(const std::vector<std::string>& paths, packets::ThumbnailAtlas& atlas) {
+        const auto key = cacheKey(paths);
+        auto itr = std::find_if(cache.begin(), cache.end(), [&](const CacheEntry& e) { return e.first == key; });
+        if (itr != cache.end()) {
+            BOOST_LOG_TRIVIAL(debug) << "Thumbnail atlas " << itr->second.hash << " is cached.";
+            atlas = itr->second;
+            return true;
+        }
+        atlas = buildThumbnailAtlas(paths, 128, 64, 4096, [this]() { return bool(cancelled); });
+        if (cancelled) {
+            return false;
+        }
+        cache.emplace_front(key, atlas);
+        if (cache.size() > maxCached) {
+            cache.pop_back();
+        }
+        return true;
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            if (!pending) {
+                workAvailable.wait(lock);
+                continue;
+            }
+            std::unique_ptr<Job> job = std::move(pending);
+            busy = true;
+            cancelled = false;
+            lock.unlock();
+
+            packets::ThumbnailAtlas atlas;
+            if (atlasFor(job->request.paths, atlas) && !cancelled) {
+                if (atlas.hash == job->request.cachedHash) {
+                    BOOST_LOG_TRIVIAL(debug) << "Client has an up to date thumbnail atlas.";
+                    atlas.image.clear();
+                }
+                job->reply(atlas);
+            } else {
+                BOOST_LOG_TRIVIAL(debug) << "Thumbnail atlas request cancelled.";
+            }
+
+            lock.lock();
+            busy = false;
+            idle.notify_all();
+        }
+    }
+
+    using CacheEntry = std::pair<std::string, packets::ThumbnailAtlas>;
+    static constexpr std::size_t maxCached = 4;
+    std::deque<CacheEntry> cache; // Most recent first.
+
+    std::unique_ptr<Job> pending;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable idle;
+    std::atomic<bool> running;
+    std::atomic<bool> cancelled; // Set when the job in progress is no longer wanted.
+    bool busy;
+    std::thread thread;
+};
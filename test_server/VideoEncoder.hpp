@@ -0,0 +1,182 @@
+// Copyright (c) 2025 Graphcore Ltd. All rights reserved.
+
+#pragma once
+
+#include <VideoLib.h>
+#include <LosslessCodec.hpp>
+#include <SharedFrameRing.hpp>
+#include <Trace.hpp>
+
+#include "ColourConversion.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Interface to a video encoder backend. Encoded data is pushed to the
+/// transport through a write function so backends do not depend on the comms
+/// system. New backends (e.g. a GPU encoder) only need to implement this and
+/// be added to createVideoEncoder() (and createVideoDecoder() on the client).
+class VideoEncoder {
+public:
+    /// Same contract as FFmpeg custom IO: return the number of bytes written
+    /// or a negative value on error.
+    using WriteFunction = std::function<int(std::uint8_t* buffer, int size)>;
+
+    virtual ~VideoEncoder() {}
+
+    /// Encode an 8-bit BGR image of the size the encoder was created with.
+    virtual bool putFrame(const cv::Mat& bgrImage) = 0;
+
+    /// Encode an image in another layout (half float layouts are tone mapped
+    /// with lut). By default it is converted to BGR first: backends that can
+    /// take the image more directly should override this.
+    virtual bool putNativeFrame(const cv::Mat& image, colour::Layout layout, const colour::ToneLut& lut) {
+        if (layout == colour::Layout::BGR) {
+            return putFrame(image);
+        }
+        colour::toBgr(image, layout, converted, lut);
+        return putFrame(converted);
+    }
+
+    /// Set the ID of the frame that is encoded next. Backends that can carry
+    /// it with the video let the client match frame infos to frames even if
+    /// it skips some.
+    void setFrameId(std::uint64_t id) {
+        frameId = id;
+    }
+
+protected:
+    std::uint64_t frameId = 0;
+
+private:
+    cv::Mat converted;
+};
+
+/// Lossy MPEG-4 encoding with FFmpeg.
+class LibAvEncoder : public VideoEncoder {
+public:
+    LibAvEncoder(int width, int height, int fps, WriteFunction write)
+        : io(FFMpegCustomIO::WriteBuffer, write),
+          writer(io) {
+        writer.AddVideoStream(width, height, fps, video::FourCc('F', 'M', 'P', '4'));
+    }
+
+    bool putFrame(const cv::Mat& bgrImage) override {
+        return putNativeFrame(bgrImage, colour::Layout::BGR, colour::defaultToneLut());
+    }
+
+    /// Converts to YUV here (in parallel) so that the writer's swscale pass
+    /// has nothing left to convert.
+    bool putNativeFrame(const cv::Mat& image, colour::Layout layout, const colour::ToneLut& lut) override {
+        {
+            TRACE_SCOPE("LibAvEncoder::convertColour");
+            colour::toI420(image, layout, yuv, lut);
+        }
+        VideoFrame frame(yuv.y(), AV_PIX_FMT_YUV420P, yuv.width, yuv.height, yuv.width);
+        return writer.PutVideoFrame(frame);
+    }
+
+private:
+    colour::I420Frame yuv;
+    FFMpegStdFunctionIO io;
+    LibAvWriter writer; // Must be destroyed before the IO.
+};
+
+/// Lossless delta/run-length encoding (see LosslessCodec.hpp). Uses far less
+/// CPU than LibAvEncoder but far more bandwidth (except for static content).
+class LosslessEncoder : public VideoEncoder {
+public:
+    LosslessEncoder(int frameWidth, int frameHeight, WriteFunction writeFunction)
+        : width(frameWidth), height(frameHeight),
+          write(writeFunction),
+          current(std::size_t(width) * height * 3),
+          previous(current.size()),
+          keyFrame(true) {}
+
+    bool putFrame(const cv::Mat& bgrImage) override {
+        TRACE_SCOPE("LosslessEncoder::putFrame");
+        if (bgrImage.cols != width || bgrImage.rows != height || bgrImage.type() != CV_8UC3) {
+            throw std::runtime_error("LosslessEncoder: image does not match the stream format.");
+        }
+
+        // Pack the rows (the image may be padded):
+        const std::size_t rowBytes = std::size_t(width) * 3;
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(current.data() + y * rowBytes, bgrImage.ptr<std::uint8_t>(y), rowBytes);
+        }
+        if (keyFrame) {
+            std::fill(previous.begin(), previous.end(), 0);
+        }
+
+        // Reserve space for the header and fill it in once the payload size is known:
+        packet.resize(sizeof(lossless::Header));
+        lossless::encodeDelta(current.data(), previous.data(), current.size(), packet);
+        lossless::Header header{lossless::magic, std::uint32_t(width), std::uint32_t(height),
+                                std::uint32_t(keyFrame), std::uint32_t(packet.size() - sizeof(lossless::Header))};
+        std::memcpy(packet.data(), &header, sizeof(header));
+        keyFrame = false;
+        std::swap(current, previous);
+
+        return write(packet.data(), packet.size()) == int(packet.size());
+    }
+
+private:
+    const int width;
+    const int height;
+    WriteFunction write;
+    std::vector<std::uint8_t> current;
+    std::vector<std::uint8_t> previous;
+    std::vector<std::uint8_t> packet;
+    bool keyFrame;
+};
+
+/// For a client on the same host: frames are copied (unencoded) into a
+/// SharedFrameRing and only a small token that identifies the frame's slot
+/// is written to the stream. The tokens keep frames in order with the other
+/// packets and wake the client's decoder exactly as encoded video would.
+class SharedMemoryEncoder : public VideoEncoder {
+public:
+    SharedMemoryEncoder(const std::string& ringName, int frameWidth, int frameHeight, WriteFunction writeFunction)
+        : ring(SharedFrameRing::create(ringName, frameWidth, frameHeight)),
+          write(writeFunction) {}
+
+    bool putFrame(const cv::Mat& bgrImage) override {
+        TRACE_SCOPE("SharedMemoryEncoder::putFrame");
+        if (bgrImage.cols != ring.width() || bgrImage.rows != ring.height() || bgrImage.type() != CV_8UC3) {
+            throw std::runtime_error("SharedMemoryEncoder: image does not match the stream format.");
+        }
+        // The frame ID is the slot's tag (exact as a double up to 2^53):
+        auto token = ring.write(bgrImage.ptr<std::uint8_t>(), bgrImage.step, double(frameId));
+        return write(reinterpret_cast<std::uint8_t*>(&token), sizeof(token)) == int(sizeof(token));
+    }
+
+private:
+    SharedFrameRing ring;
+    WriteFunction write;
+};
+
+/// Create an encoder backend by name ("libav", "lossless" or "shm"). The names
+/// must match those recognised by createVideoDecoder() on the client. "shm"
+/// needs the name of the shared memory to create.
+inline std::unique_ptr<VideoEncoder> createVideoEncoder(const std::string& codec, int width, int height, int fps,
+                                                        VideoEncoder::WriteFunction write,
+                                                        const std::string& sharedMemory = "") {
+    if (codec == "libav") {
+        return std::make_unique<LibAvEncoder>(width, height, fps, write);
+    }
+    if (codec == "lossless") {
+        return std::make_unique<LosslessEncoder>(width, height, write);
+    }
+    if (codec == "shm") {
+        return std::make_unique<SharedMemoryEncoder>(sharedMemory, width, height, write);
+    }
+    throw std::runtime_error("Unknown video codec: '" + codec + "'");
+}
@@ -6,9 +6,18 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 
+#include "AssetManager.hpp"
 #include "InterfaceServer.hpp"
+#include "SharedSession.hpp"
+#include "TestPattern.hpp"
+
+#include <sched.h>
 
 boost::program_options::options_description getOptions() {
   namespace po = boost::program_options;
@@ -16,10 +25,144 @@ boost::program_options::options_description getOptions() {
   desc.add_options()
   ("help", "Show command help.")
   ("port", po::value<int>()->default_value(4242), "Port to listen for connections on.")
+  ("video-port", po::value<int>()->default_value(0), "Send video on a separate connection on this port so it never delays control packets (0 to share the main connection).")
+  ("no-shared-memory", po::bool_switch()->default_value(false), "Always encode video (by default a client on the same host receives raw frames through shared memory).")
+  ("record-session", po::value<std::string>()->default_value(""), "Save the encoded video stream to this file.")
+  ("metrics-port", po::value<int>()->default_value(0), "Serve Prometheus style metrics on this port (0 to disable).")
+  ("width", po::value<int>()->default_value(640), "Width of the test video in pixels.")
+  ("height", po::value<int>()->default_value(480), "Height of the test video in pixels.")
+  ("fps", po::value<int>()->default_value(30), "Frames per second to send (0 sends as fast as possible).")
+  ("profile", po::value<std::string>()->default_value("scrolling"), "Test pattern: 'static', 'scrolling', 'noise' (worst case for the encoder) or 'regions' (small changes on a static background).")
+  ("codec", po::value<std::string>()->default_value("libav"), "Video encoder backend: 'libav' (lossy MPEG-4) or 'lossless' (cheap on the CPU but needs a fast network).")
+  ("hdr", po::bool_switch()->default_value(false), "Send the render preview as a log-encoded HDR stream so exposure and tone mapping are applied by the client.")
+  ("damage-tracking", po::bool_switch()->default_value(false), "Skip or rate limit frames that have barely changed since the last frame sent.")
+  ("aux-streams", po::bool_switch()->default_value(false), "Also send example albedo and heat-map video streams.")
+  ("daemon", po::value<std::string>()->default_value(""), "Stream frames written by a renderer into this shared memory session (see FrameProducer) instead of the test pattern.")
+  ("cpus", po::value<std::string>()->default_value(""), "Only run on these CPUs, e.g. '4-7' or '2,3' (keeps encoding off the cores a renderer uses).")
+  ("trace", po::value<std::string>()->default_value(""), "Record trace events and write them to this file (Chrome trace JSON) on exit.")
+  ("asset-cache-mb", po::value<std::size_t>()->default_value(512), "Memory budget for cached scene assets in megabytes.")
   ("log-level", po::value<std::string>()->default_value("info"), "Set the log level to one of the following: 'trace', 'debug', 'info', 'warn', 'err', 'critical', 'off'.");
   return desc;
 }
 
+// The test server does not render so its scene assets are just raw bytes:
+using SceneAsset = std::vector<std::uint8_t>;
+
+/// Load the file at path or, if it can not be read, simulate loading a large asset.
+std::shared_ptr<const SceneAsset> loadSceneAsset(const std::string& path, const AssetManager<SceneAsset>::ProgressCallback& progress) {
+    const std::size_t chunkSize = 4 * 1024 * 1024;
+    auto asset = std::make_shared<SceneAsset>();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    const std::streamoff fileSize = file ? std::streamoff(file.tellg()) : 0;
+    if (fileSize > 0) {
+        const std::size_t size = fileSize;
+        asset->resize(size);
+        file.seekg(0);
+        for (std::size_t offset = 0; offset < size; offset += chunkSize) {
+            file.read(reinterpret_cast<char*>(asset->data() + offset), std::min(chunkSize, size - offset));
+            if (!progress(float(offset + chunkSize) / size)) {
+                return nullptr;
+            }
+        }
+        return asset;
+    }
+
+    const std::size_t simulatedChunks = 16;
+    const std::uint8_t fill = std::hash<std::string>()(path) & 0xff;
+    for (std::size_t c = 0; c < simulatedChunks; ++c) {
+        asset->resize(asset->size() + chunkSize, fill);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (!progress(float(c + 1) / simulatedChunks)) {
+            return nullptr;
+        }
+    }
+    return asset;
+}
+
+/// Restrict the process (and so all the threads it starts later) to a list of CPUs like "0,2,4-7".
+void setCpuAffinity(const std::string& list) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        const auto dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Could not set CPU affinity to " << list;
+    } else {
+        BOOST_LOG_TRIVIAL(info) << "Running on CPUs " << list;
+    }
+}
+
+/// Serve a renderer's frames from a shared memory session until the client
+/// stops the render, disconnects, or the renderer exits.
+void runDaemon(InterfaceServer& server, SessionFeed& feed) {
+    std::map<std::string, bool> initialised; // False if the stream could not be initialised.
+    session::RenderStatus status;
+    bool stopped = false;
+    while (!stopped && feed.producerAlive() && server.clientConnected()) {
+        feed.heartbeat();
+
+        // The renderer can add streams at any time:
+        for (const auto& stream : feed.streams()) {
+            if (!initialised.count(stream.name)) {
+                server.initialiseVideoStream(stream.width, stream.height, stream.name, stream.fps, stream.codec, stream.transfer);
+                initialised[stream.name] = true;
+            }
+        }
+
+        bool sent = false;
+        for (auto& stream : initialised) {
+            if (!stream.second || !server.isStreamVisible(stream.first)) {
+                continue;
+            }
+            auto frame = server.acquireFrame(stream.first);
+            if (!frame) {
+                stream.second = false;
+                continue;
+            }
+            cv::Mat image = frame->mat();
+            float value = 0.f;
+            if (feed.readNewFrame(stream.first, image, value)) {
+                server.setRenderedValue(value);
+                server.submitFrame(frame, stream.first);
+                sent = true;
+            }
+        }
+
+        // Forward control state to the renderer and its status to the client
+        // (a stop is only acted on once it has been forwarded so that the
+        // renderer stops too):
+        if (server.stateChanged()) {
+            auto state = server.consumeState();
+            BOOST_LOG_TRIVIAL(info) << "State updated: " << state.toString();
+            feed.publishState(state);
+            stopped = state.stop;
+        }
+        if (feed.readStatus(status)) {
+            server.updateProgress(status.progressStep, status.progressTotal);
+            server.updateSampleStats(status.accumulatedSamples, status.targetSamples);
+        }
+
+        if (!sent) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (!feed.producerAlive()) {
+        BOOST_LOG_TRIVIAL(info) << "Renderer has closed the session (or stopped responding).";
+    } else if (!stopped) {
+        // The render carries on so that another daemon can serve it:
+        BOOST_LOG_TRIVIAL(info) << "Client disconnected.";
+    }
+}
+
 int main(int argc, char* argv[]) {
     auto args = parseOptions(argc, argv, getOptions());
 
@@ -31,8 +174,41 @@ int main(int argc, char* argv[]) {
     int port = args.at("port").as<int>();
     BOOST_LOG_TRIVIAL(info) << "Starting server on port " << port;
 
+    // Pin before any threads are started so that they all inherit it:
+    const auto cpus = args.at("cpus").as<std::string>();
+    if (!cpus.empty()) {
+        setCpuAffinity(cpus);
+    }
+
+    // In daemon mode the renderer must have created the session already:
+    std::unique_ptr<SessionFeed> feed;
+    const auto daemonSession = args.at("daemon").as<std::string>();
+    if (!daemonSession.empty()) {
+        try {
+            feed = std::make_unique<SessionFeed>(daemonSession);
+        } catch (const std::exception& e) {
+            BOOST_LOG_TRIVIAL(error) << "Could not open session '" << daemonSession << "': " << e.what();
+            return EXIT_FAILURE;
+        }
+    }
+
     // Create and start the server
     InterfaceServer server(port);
+    const auto sessionFile = args.at("record-session").as<std::string>();
+    if (!sessionFile.empty()) {
+        server.recordSession(sessionFile);
+    }
+    const int videoPort = args.at("video-port").as<int>();
+    if (videoPort != 0) {
+        server.useVideoChannel(videoPort);
+    }
+    server.allowSharedMemory(!args.at("no-shared-memory").as<bool>());
+    const int metricsPort = args.at("metrics-port").as<int>();
+    if (metricsPort != 0) {
+        server.serveMetrics(metricsPort);
+    }
+    const auto traceFile = args.at("trace").as<std::string>();
+    InterfaceServer::setTracing(!traceFile.empty());
     server.start();
     const bool ok = server.waitUntilReady();
     if (!ok) {
@@ -40,58 +216,163 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    // Create a simple test image to send periodically
-    cv::Mat testImage(480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
-    server.initialiseVideoStream(testImage.cols, testImage.rows);
+    // Scene assets selected by the client are loaded in the background:
+    AssetManager<SceneAsset> assets(loadSceneAsset, [](const SceneAsset& asset) { return asset.size(); },
+                                    args.at("asset-cache-mb").as<std::size_t>() * 1024 * 1024);
+    assets.setStatusCallback([&server](const std::string& path, float progress, const std::string& error) {
+        server.updateAssetStatus(path, progress, error);
+    });
+
+    if (args.at("damage-tracking").as<bool>()) {
+        server.enableDamageTracking();
+    }
+
+    auto shutdown = [&]() {
+        BOOST_LOG_TRIVIAL(info) << "Shutting down server...";
+        server.stop();
+        if (!traceFile.empty()) {
+            BOOST_LOG_TRIVIAL(info) << "Wrote " << InterfaceServer::writeTrace(traceFile) << " trace events to " << traceFile;
+        }
+        BOOST_LOG_TRIVIAL(info) << "Exiting.";
+    };
+
+    if (feed) {
+        try {
+            runDaemon(server, *feed);
+        } catch (const std::exception& e) {
+            BOOST_LOG_TRIVIAL(error) << "Exception in daemon loop: " << e.what();
+        }
+        shutdown();
+        return EXIT_SUCCESS;
+    }
+
+    // Create a synthetic test pattern to send periodically:
+    const int width = args.at("width").as<int>();
+    const int height = args.at("height").as<int>();
+    const int fps = args.at("fps").as<int>();
+    TestPattern pattern(TestPattern::parseProfile(args.at("profile").as<std::string>()), width, height);
+    const auto codec = args.at("codec").as<std::string>();
+    const bool hdr = args.at("hdr").as<bool>();
+    server.initialiseVideoStream(width, height, "render_preview", fps > 0 ? fps : 30, codec, hdr ? "log" : "srgb");
+    cv::Mat hdrImage;
+    const bool auxStreams = args.at("aux-streams").as<bool>();
+    cv::Mat grayImage;
+    if (auxStreams) {
+        server.initialiseVideoStream(width, height, "albedo_preview", fps > 0 ? fps : 30, codec);
+        server.initialiseVideoStream(width, height, "heatmap_preview", fps > 0 ? fps : 30, codec);
+    }
 
     // Main loop - keep running until interrupted
     try {
-        int frameOffset = 0;
+        std::uint64_t frameIndex = 0;
+        const auto startTime = std::chrono::steady_clock::now();
+
+        // Servers rendering tiles of one image number frames by wall clock
+        // time slot so that every server renders (and tags) the same frame
+        // at the same time and the client can stitch matching tiles:
+        const auto tile = server.tileAssignment();
+        const bool tiled = tile.count > 1;
+        const auto slotPeriod = std::chrono::microseconds(1000000 / (fps > 0 ? fps : 30));
+        if (tiled) {
+            BOOST_LOG_TRIVIAL(info) << "Rendering rows " << tile.top(height) << " to " << tile.bottom(height)
+                                    << " of the test pattern.";
+        }
+        std::uint64_t accumulatedSamples = 0;
+        const std::uint64_t targetSamples = 4096;
+        std::string currentNif;
+        // The control value is treated as the camera's yaw angle in radians:
+        float yaw = server.getState().value;
         while (!server.getState().stop) {
 
-            // Update test image (create a scrolling gradient)
-            for (int y = 0; y < testImage.rows; y++) {
-                for (int x = 0; x < testImage.cols; x++) {
-                    // Add frameOffset to x to create scrolling effect
-                    int shiftedX = (x + frameOffset) % testImage.cols;
-                    testImage.at<cv::Vec3b>(y, x) = cv::Vec3b(
-                        shiftedX % 255,                // Blue
-                        (shiftedX + y) % 255,          // Green
-                        y % 255                        // Red
-                    );
-                }
-            }
+            // Tint the test image differently for each scene:
+            const auto scene = assets.getCurrent();
+            const std::uint8_t sceneTint = scene && !scene->empty() ? scene->front() : 0;
 
-            // Increment the offset for the next frame
-            frameOffset = (frameOffset + 1) % testImage.cols;
+            // Render the test image straight into a pooled frame buffer and send it:
+            auto frame = server.acquireFrame();
+            if (!frame) {
+                break;
+            }
+            cv::Mat testImage = frame->mat();
+            if (tiled) {
+                frameIndex = std::chrono::system_clock::now().time_since_epoch() / slotPeriod;
+                server.setFrameId(frameIndex);
+            }
+            const int yawShift = int(std::lround(yaw / (2.0 * M_PI) * width));
+            pattern.render(frameIndex, sceneTint, testImage, yawShift);
+            frameIndex += 1;
+            if (hdr) {
+                // Fake an HDR render by linearising the pattern and boosting it two stops:
+                testImage.convertTo(hdrImage, CV_32FC3, 1.0 / 255.0);
+                cv::pow(hdrImage, 2.2, hdrImage);
+                hdrImage *= 4.0;
+                server.sendHdrImage(hdrImage);
+            } else {
+                server.submitFrame(frame);
+            }
 
-            // Send a preview image
-            server.sendImage(testImage);
+            // Auxiliary streams are only generated while the client is displaying them.
+            // OpenCV writes into the pooled buffers in place because their size and type match:
+            if (auxStreams && server.isStreamVisible("albedo_preview")) {
+                auto albedo = server.acquireFrame("albedo_preview");
+                if (!albedo) {
+                    break;
+                }
+                cv::Mat albedoImage = albedo->mat();
+                cv::blur(testImage, albedoImage, cv::Size(15, 15));
+                server.submitFrame(albedo, "albedo_preview");
+            }
+            if (auxStreams && server.isStreamVisible("heatmap_preview")) {
+                auto heatmap = server.acquireFrame("heatmap_preview");
+                if (!heatmap) {
+                    break;
+                }
+                cv::Mat heatmapImage = heatmap->mat();
+                cv::cvtColor(testImage, grayImage, cv::COLOR_BGR2GRAY);
+                cv::applyColorMap(grayImage, heatmapImage, cv::COLORMAP_JET);
+                server.submitFrame(heatmap, "heatmap_preview");
+            }
 
-            // Send some fake progress updates
+            // Send some fake progress updates (unless the progress bar is showing an asset load):
             static int step = 0;
             const int totalSteps = 100;
             step = (step + 1) % totalSteps;
-            server.updateProgress(step, totalSteps);
+            if (currentNif.empty() || assets.settled()) {
+                server.updateProgress(step, totalSteps);
+            }
+
+            // Pretend each frame accumulates the requested number of samples:
+            accumulatedSamples += server.getState().samples;
+            server.updateSampleStats(accumulatedSamples, targetSamples);
 
             // Check if state was updated by client
             if (server.stateChanged()) {
                 auto state = server.consumeState();
                 BOOST_LOG_TRIVIAL(info) << "State updated:";
                 BOOST_LOG_TRIVIAL(info) << state.toString();
+                if (state.nifPath != currentNif) {
+                    currentNif = state.nifPath;
+                    assets.select(currentNif);
+                }
+                assets.prefetch(state.prefetchPaths);
+                yaw = state.value;
+                // A real renderer would restart accumulation here:
+                accumulatedSamples = 0;
             }
 
-            // Sleep 5ms to avoid consuming too much CPU:
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            // Pace frames to the requested rate:
+            if (tiled) {
+                std::this_thread::sleep_until(std::chrono::system_clock::time_point(frameIndex * slotPeriod));
+            } else if (fps > 0) {
+                std::this_thread::sleep_until(startTime + frameIndex * std::chrono::microseconds(1000000 / fps));
+            }
         }
 
     } catch (const std::exception& e) {
         BOOST_LOG_TRIVIAL(error) << "Exception in main loop: " << e.what();
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Shutting down server...";
-    server.stop();
-    BOOST_LOG_TRIVIAL(info) << "Exiting.";
+    shutdown();
 
     return EXIT_SUCCESS;
 }